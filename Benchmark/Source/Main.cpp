@@ -0,0 +1,1157 @@
+/*
+  ==============================================================================
+
+    Standalone benchmark for the Destruction plugin, runs outside a DAW.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include <iostream>
+#include <thread>
+#include "../../Source/PluginProcessor.h"
+#include "../../Source/PluginEditor.h"
+#include "RealtimeSafety.h"
+//==============================================================================
+static double ticksToMicroseconds(juce::int64 ticks)
+{
+    return 1.0e6 * static_cast<double>(ticks) / static_cast<double>(juce::Time::getHighResolutionTicksPerSecond());
+}
+
+static juce::Array<int> getIntListOption(const juce::ArgumentList& args, const juce::String& option, juce::Array<int> defaultValues)
+{
+    const auto value{ args.getValueForOption(option) };
+    if (value.isEmpty()) { return defaultValues; }
+    juce::Array<int> values;
+    for (const auto& token : juce::StringArray::fromTokens(value, ",", "")) { values.add(token.getIntValue()); }
+    return values;
+}
+
+static int getIntOption(const juce::ArgumentList& args, const juce::String& option, int defaultValue)
+{
+    const auto value{ args.getValueForOption(option) };
+    return value.isEmpty() ? defaultValue : juce::jmax(1, value.getIntValue());
+}
+//==============================================================================
+static void runStateBenchmark(const juce::ArgumentList& args)
+{
+    /* Измеряет время сохранения и восстановления состояния одного экземпляра
+    для бинарного и устаревшего XML форматов, как при загрузке проекта
+    с большим количеством экземпляров плагина. */
+    const int numInstances{ getIntOption(args, "--instances", 300) };
+    const int numIterations{ getIntOption(args, "--iterations", 10) };
+    std::vector<std::unique_ptr<DestructionAudioProcessor>> instances;
+    for (int i = 0; i < numInstances; ++i) { instances.push_back(std::make_unique<DestructionAudioProcessor>()); }
+
+    auto measure = [&](const juce::String& formatName, bool legacy)
+    {
+        std::vector<juce::MemoryBlock> states(instances.size());
+        juce::int64 saveTicks{ 0 };
+        juce::int64 restoreTicks{ 0 };
+        for (int iteration = 0; iteration < numIterations; ++iteration)
+        {
+            auto start{ juce::Time::getHighResolutionTicks() };
+            for (size_t i = 0; i < instances.size(); ++i)
+            {
+                states[i].reset();
+                if (legacy) { instances[i]->getLegacyStateInformation(states[i]); }
+                else { instances[i]->getStateInformation(states[i]); }
+            }
+            saveTicks += juce::Time::getHighResolutionTicks() - start;
+            start = juce::Time::getHighResolutionTicks();
+            for (size_t i = 0; i < instances.size(); ++i)
+            {
+                instances[i]->setStateInformation(states[i].getData(), static_cast<int>(states[i].getSize()));
+            }
+            restoreTicks += juce::Time::getHighResolutionTicks() - start;
+        }
+        const double numMeasurements{ static_cast<double>(numInstances) * numIterations };
+        std::cout << formatName.paddedRight(' ', 10)
+                  << juce::String(states.front().getSize()).paddedLeft(' ', 8) << " bytes"
+                  << juce::String(ticksToMicroseconds(saveTicks) / numMeasurements, 2).paddedLeft(' ', 12) << " us save"
+                  << juce::String(ticksToMicroseconds(restoreTicks) / numMeasurements, 2).paddedLeft(' ', 12) << " us restore"
+                  << std::endl;
+    };
+
+    std::cout << "State save/restore per instance (" << numInstances << " instances, "
+              << numIterations << " iterations)" << std::endl;
+    measure("binary", false);
+    measure("xml", true);
+}
+//==============================================================================
+struct DspBenchmarkResult
+{
+    juce::String target;
+    juce::String variant;
+    juce::String sampleType;
+    juce::String clipperName;
+    double clip;
+    int blockSize;
+    int numChannels;
+    double nsPerSample;
+    double cyclesPerSample;
+    double samplesPerSecond;
+
+    juce::var toVar() const
+    {
+        auto* object{ new juce::DynamicObject() };
+        object->setProperty("target", target);
+        object->setProperty("variant", variant);
+        object->setProperty("sampleType", sampleType);
+        object->setProperty("clipper", clipperName);
+        object->setProperty("clip", clip);
+        object->setProperty("blockSize", blockSize);
+        object->setProperty("channels", numChannels);
+        object->setProperty("nsPerSample", nsPerSample);
+        object->setProperty("cyclesPerSample", cyclesPerSample);
+        object->setProperty("samplesPerSecond", samplesPerSecond);
+        return juce::var(object);
+    }
+};
+
+static const juce::StringArray clipperNames{ "Hard Clip", "Soft Clip", "Fold Back", "Sine Fold", "Linear Fold", "Custom" };
+
+template <typename SampleType>
+static std::unique_ptr<Clipper<SampleType>> createClipper(int clipperType)
+{
+    switch (clipperType)
+    {
+    case 0: return std::make_unique<HardClipper<SampleType>>(HARDCLIP_COEF);
+    case 1: return std::make_unique<SoftClipper<SampleType>>(SOFTCLIP_COEF);
+    case 2: return std::make_unique<FoldbackClipper<SampleType>>(FOLDBACK_COEF);
+    case 3: return std::make_unique<SineFoldClipper<SampleType>>(SINEFOLD_COEF);
+    case 4: return std::make_unique<LinearFoldClipper<SampleType>>(LINEARFOLD_COEF);
+    default: return std::make_unique<CustomClipper<SampleType>>(CUSTOM_COEF);
+    }
+}
+
+class DspBenchmark
+    /* Прогоняет детерминированный шум через каждое ядро клиппера и через
+    processBlock целиком. Данные копируются в рабочий буфер вне замера,
+    чтобы каждый проход обрабатывал одинаковый сигнал. */
+{
+public:
+    DspBenchmark(int _totalSamples, int _numPasses) : totalSamples(_totalSamples), numPasses(_numPasses) { }
+
+    template <typename SampleType>
+    void runClipper(int clipperType, double clip, int blockSize, int numChannels, bool blockKernel)
+    {
+        auto clipper{ createClipper<SampleType>(clipperType) };
+        clipper->updateMultiplier(clip);
+        juce::AudioBuffer<SampleType> source{ numChannels, totalSamples };
+        juce::AudioBuffer<SampleType> work{ numChannels, totalSamples };
+        fillWithNoise(source);
+        juce::int64 ticks{ 0 };
+        juce::uint64 cycles{ 0 };
+        for (int pass = 0; pass < numPasses; ++pass)
+        {
+            work.makeCopyOf(source, true);
+            const auto startTicks{ juce::Time::getHighResolutionTicks() };
+            const auto startCycles{ readCycleCounter() };
+            for (int offset = 0; offset + blockSize <= totalSamples; offset += blockSize)
+            {
+                for (int channel = 0; channel < numChannels; ++channel)
+                {
+                    auto* data{ work.getWritePointer(channel, offset) };
+                    if (blockKernel) { clipper->processBlock(data, blockSize); }
+                    else { for (int i = 0; i < blockSize; ++i) { data[i] = clipper->process(data[i]); } }
+                }
+            }
+            cycles += readCycleCounter() - startCycles;
+            ticks += juce::Time::getHighResolutionTicks() - startTicks;
+        }
+        addResult("Clipper", blockKernel ? "processBlock" : "process",
+                  std::is_same<SampleType, float>::value ? "float" : "double",
+                  clipperNames[clipperType], clip, blockSize, numChannels, ticks, cycles);
+    }
+
+    template <typename SampleType>
+    void runModulatedClipper(int clipperType, double clip, int blockSize, int numChannels)
+    {
+        // посэмпловый множитель как от огибающей сайдчейна: разница с processBlock - цена динамического драйва
+        auto clipper{ createClipper<SampleType>(clipperType) };
+        clipper->updateMultiplier(clip);
+        juce::AudioBuffer<SampleType> source{ numChannels, totalSamples };
+        juce::AudioBuffer<SampleType> work{ numChannels, totalSamples };
+        fillWithNoise(source);
+        std::vector<SampleType> gains(static_cast<size_t>(blockSize));
+        for (int i = 0; i < blockSize; ++i) { gains[static_cast<size_t>(i)] = static_cast<SampleType>(1.0 + static_cast<double>(i) / blockSize); }
+        juce::int64 ticks{ 0 };
+        juce::uint64 cycles{ 0 };
+        for (int pass = 0; pass < numPasses; ++pass)
+        {
+            work.makeCopyOf(source, true);
+            const auto startTicks{ juce::Time::getHighResolutionTicks() };
+            const auto startCycles{ readCycleCounter() };
+            for (int offset = 0; offset + blockSize <= totalSamples; offset += blockSize)
+            {
+                for (int channel = 0; channel < numChannels; ++channel)
+                {
+                    clipper->processModulatedBlock(work.getWritePointer(channel, offset), gains.data(), blockSize);
+                }
+            }
+            cycles += readCycleCounter() - startCycles;
+            ticks += juce::Time::getHighResolutionTicks() - startTicks;
+        }
+        addResult("Clipper", "processModulatedBlock",
+                  std::is_same<SampleType, float>::value ? "float" : "double",
+                  clipperNames[clipperType], clip, blockSize, numChannels, ticks, cycles);
+    }
+
+    void runProcessor(int clipperType, double clip, int blockSize, int numChannels, bool transientSplit)
+    {
+        // transientSplit: режим разделения транзиентов должен укладываться в 1,5 раза от обычного клиппинга
+        const double sampleRate{ 48000.0 };
+        DestructionAudioProcessor processor;
+        processor.setPlayConfigDetails(numChannels, numChannels, sampleRate, blockSize);
+        processor.prepareToPlay(sampleRate, blockSize);
+        ParameterSnapshot snapshot;
+        snapshot.clipperType = clipperType;
+        snapshot.clip = clip;
+        processor.applyParameterSnapshot(snapshot);
+        if (transientSplit)
+        {
+            setParameter(processor, "Transient Split", 1.0f);
+            setParameter(processor, "Transient Clip", static_cast<float>(juce::jmin(10.0, clip * 2.0)));
+        }
+        juce::AudioBuffer<float> source{ numChannels, totalSamples };
+        juce::AudioBuffer<float> work{ numChannels, totalSamples };
+        fillWithNoise(source);
+        juce::MidiBuffer midi;
+        juce::int64 ticks{ 0 };
+        juce::uint64 cycles{ 0 };
+        for (int pass = 0; pass < numPasses; ++pass)
+        {
+            work.makeCopyOf(source, true);
+            const auto startTicks{ juce::Time::getHighResolutionTicks() };
+            const auto startCycles{ readCycleCounter() };
+            for (int offset = 0; offset + blockSize <= totalSamples; offset += blockSize)
+            {
+                juce::AudioBuffer<float> block{ work.getArrayOfWritePointers(), numChannels, offset, blockSize };
+                processor.processBlock(block, midi);
+            }
+            cycles += readCycleCounter() - startCycles;
+            ticks += juce::Time::getHighResolutionTicks() - startTicks;
+        }
+        processor.releaseResources();
+        addResult("DestructionAudioProcessor", transientSplit ? "processBlock+transientSplit" : "processBlock", "float",
+                  clipperNames[clipperType], clip, blockSize, numChannels, ticks, cycles);
+    }
+
+    void runChain(const juce::Array<int>& stageTypes, double clip, int blockSize, int numChannels, bool fused)
+    {
+        /* fused - один экземпляр с каскадом ступеней, иначе цепочка экземпляров
+        по одной ступени, как в сессии, собранной до появления каскада. */
+        const double sampleRate{ 48000.0 };
+        const int numStages{ juce::jlimit(1, MAX_CLIP_STAGES, stageTypes.size()) };
+        std::vector<std::unique_ptr<DestructionAudioProcessor>> chain;
+        for (int i = 0; i < (fused ? 1 : numStages); ++i)
+        {
+            auto processor{ std::make_unique<DestructionAudioProcessor>() };
+            processor->setPlayConfigDetails(numChannels, numChannels, sampleRate, blockSize);
+            processor->prepareToPlay(sampleRate, blockSize);
+            ParameterSnapshot snapshot;
+            snapshot.clipperType = stageTypes[i];
+            snapshot.clip = clip;
+            processor->applyParameterSnapshot(snapshot);
+            if (fused)
+            {
+                setParameter(*processor, "Stages", static_cast<float>(numStages));
+                for (int stage = 1; stage < numStages; ++stage)
+                {
+                    const auto prefix{ "Stage " + juce::String(stage + 1) + " " };
+                    setParameter(*processor, prefix + "Type", static_cast<float>(stageTypes[stage]));
+                    setParameter(*processor, prefix + "Clip", static_cast<float>(clip));
+                }
+            }
+            chain.push_back(std::move(processor));
+        }
+        juce::AudioBuffer<float> source{ numChannels, totalSamples };
+        juce::AudioBuffer<float> work{ numChannels, totalSamples };
+        fillWithNoise(source);
+        juce::MidiBuffer midi;
+        juce::int64 ticks{ 0 };
+        juce::uint64 cycles{ 0 };
+        for (int pass = 0; pass < numPasses; ++pass)
+        {
+            work.makeCopyOf(source, true);
+            const auto startTicks{ juce::Time::getHighResolutionTicks() };
+            const auto startCycles{ readCycleCounter() };
+            for (int offset = 0; offset + blockSize <= totalSamples; offset += blockSize)
+            {
+                juce::AudioBuffer<float> block{ work.getArrayOfWritePointers(), numChannels, offset, blockSize };
+                for (auto& processor : chain) { processor->processBlock(block, midi); }
+            }
+            cycles += readCycleCounter() - startCycles;
+            ticks += juce::Time::getHighResolutionTicks() - startTicks;
+        }
+        juce::StringArray stageNames;
+        for (int stage = 0; stage < numStages; ++stage) { stageNames.add(clipperNames[stageTypes[stage]]); }
+        for (auto& processor : chain) { processor->releaseResources(); }
+        addResult("Chain", fused ? "fused" : "instances", "float",
+                  stageNames.joinIntoString(" > "), clip, blockSize, numChannels, ticks, cycles);
+    }
+
+    void runEmphasis(int blockSize, int numChannels)
+    {
+        // пара пред/деэмфазиса должна стоить меньше самого клиппера при том же размере блока
+        EmphasisFilter emphasis;
+        emphasis.prepare(48000.0, numChannels, blockSize);
+        juce::AudioBuffer<float> source{ numChannels, totalSamples };
+        juce::AudioBuffer<float> work{ numChannels, totalSamples };
+        fillWithNoise(source);
+        juce::int64 ticks{ 0 };
+        juce::uint64 cycles{ 0 };
+        for (int pass = 0; pass < numPasses; ++pass)
+        {
+            work.makeCopyOf(source, true);
+            const auto startTicks{ juce::Time::getHighResolutionTicks() };
+            const auto startCycles{ readCycleCounter() };
+            for (int offset = 0; offset + blockSize <= totalSamples; offset += blockSize)
+            {
+                emphasis.setTilt(6.0f, 1000.0f, blockSize); // как в processBlock: рампа первого прохода входит в замер
+                for (int channel = 0; channel < numChannels; ++channel)
+                {
+                    auto* data{ work.getWritePointer(channel, offset) };
+                    emphasis.processPre(channel, data, blockSize);
+                    emphasis.processPost(channel, data, blockSize);
+                }
+            }
+            cycles += readCycleCounter() - startCycles;
+            ticks += juce::Time::getHighResolutionTicks() - startTicks;
+        }
+        addResult("EmphasisFilter", "pre+post", "float", "-", 0.0, blockSize, numChannels, ticks, cycles);
+    }
+
+    const std::vector<DspBenchmarkResult>& getResults() const { return results; }
+private:
+    template <typename SampleType>
+    static void fillWithNoise(juce::AudioBuffer<SampleType>& buffer)
+    {
+        juce::Random random{ 0x5eed };
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        {
+            auto* data{ buffer.getWritePointer(channel) };
+            for (int i = 0; i < buffer.getNumSamples(); ++i) { data[i] = static_cast<SampleType>(random.nextDouble() * 2.0 - 1.0); }
+        }
+    }
+
+    static void setParameter(DestructionAudioProcessor& processor, const juce::String& parameterID, float value)
+    {
+        auto* parameter{ processor.apvts.getParameter(parameterID) };
+        parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+    }
+
+    void addResult(const juce::String& target, const juce::String& variant, const juce::String& sampleType,
+                   const juce::String& clipperName, double clip, int blockSize, int numChannels, juce::int64 ticks, juce::uint64 cycles)
+    {
+        const int numBlocks{ totalSamples / blockSize };
+        const double numSamples{ static_cast<double>(numBlocks) * blockSize * numChannels * numPasses };
+        const double seconds{ static_cast<double>(ticks) / static_cast<double>(juce::Time::getHighResolutionTicksPerSecond()) };
+        results.push_back({ target, variant, sampleType, clipperName, clip, blockSize, numChannels,
+                            1.0e9 * seconds / numSamples,
+                            static_cast<double>(cycles) / numSamples,
+                            seconds > 0.0 ? numSamples / seconds : 0.0 });
+    }
+
+    int totalSamples;
+    int numPasses;
+    std::vector<DspBenchmarkResult> results;
+};
+
+static void runDspBenchmark(const juce::ArgumentList& args)
+{
+    const auto clipValues{ getIntListOption(args, "--clip", { 1, 3, 5, 10 }) };
+    const auto blockSizes{ getIntListOption(args, "--blocks", { 16, 64, 256, 1024, 4096 }) };
+    const auto channelCounts{ getIntListOption(args, "--channels", { 1, 2 }) };
+    DspBenchmark benchmark{ getIntOption(args, "--samples", 1 << 16), getIntOption(args, "--passes", 20) };
+    const auto stageTypes{ getIntListOption(args, "--stages", {}) };
+    for (int clipperType = 0; clipperType < clipperNames.size() && stageTypes.isEmpty(); ++clipperType)
+    {
+        for (auto clip : clipValues)
+        {
+            for (auto blockSize : blockSizes)
+            {
+                for (auto numChannels : channelCounts)
+                {
+                    benchmark.runClipper<float>(clipperType, clip, blockSize, numChannels, false);
+                    benchmark.runClipper<float>(clipperType, clip, blockSize, numChannels, true);
+                    benchmark.runModulatedClipper<float>(clipperType, clip, blockSize, numChannels);
+                    benchmark.runClipper<double>(clipperType, clip, blockSize, numChannels, false);
+                    benchmark.runClipper<double>(clipperType, clip, blockSize, numChannels, true);
+                    benchmark.runProcessor(clipperType, clip, blockSize, numChannels, false);
+                    benchmark.runProcessor(clipperType, clip, blockSize, numChannels, true);
+                }
+            }
+        }
+    }
+    for (int i = 0; i < blockSizes.size() && stageTypes.isEmpty(); ++i)
+    {
+        for (auto numChannels : channelCounts) { benchmark.runEmphasis(blockSizes[i], numChannels); }
+    }
+    // --stages сравнивает каскад в одном экземпляре с цепочкой экземпляров
+    for (auto clipperType : stageTypes)
+    {
+        if (!juce::isPositiveAndBelow(clipperType, clipperNames.size()))
+        {
+            juce::ConsoleApplication::fail("Unknown clipper type in --stages", 1);
+        }
+    }
+    for (int i = 0; i < clipValues.size() && !stageTypes.isEmpty(); ++i)
+    {
+        for (auto blockSize : blockSizes)
+        {
+            for (auto numChannels : channelCounts)
+            {
+                benchmark.runChain(stageTypes, clipValues[i], blockSize, numChannels, false);
+                benchmark.runChain(stageTypes, clipValues[i], blockSize, numChannels, true);
+            }
+        }
+    }
+
+    if (args.containsOption("--json"))
+    {
+        juce::Array<juce::var> entries;
+        for (const auto& result : benchmark.getResults()) { entries.add(result.toVar()); }
+        auto* root{ new juce::DynamicObject() };
+        root->setProperty("benchmark", "dsp");
+        root->setProperty("cpu", juce::SystemStats::getCpuModel());
+        root->setProperty("results", entries);
+        const auto json{ juce::JSON::toString(juce::var(root)) };
+        const auto outputPath{ args.getValueForOption("--output") };
+        if (outputPath.isEmpty()) { std::cout << json << std::endl; }
+        else { juce::File::getCurrentWorkingDirectory().getChildFile(outputPath).replaceWithText(json); }
+        return;
+    }
+
+    std::cout << "target                     variant       type    clipper      clip  block  ch     ns/smp  cyc/smp   Msmp/s" << std::endl;
+    for (const auto& result : benchmark.getResults())
+    {
+        std::cout << result.target.paddedRight(' ', 27)
+                  << result.variant.paddedRight(' ', 14)
+                  << result.sampleType.paddedRight(' ', 8)
+                  << result.clipperName.paddedRight(' ', 12)
+                  << juce::String(result.clip, 1).paddedLeft(' ', 5)
+                  << juce::String(result.blockSize).paddedLeft(' ', 7)
+                  << juce::String(result.numChannels).paddedLeft(' ', 4)
+                  << juce::String(result.nsPerSample, 3).paddedLeft(' ', 11)
+                  << juce::String(result.cyclesPerSample, 2).paddedLeft(' ', 9)
+                  << juce::String(result.samplesPerSecond * 1.0e-6, 1).paddedLeft(' ', 9)
+                  << std::endl;
+    }
+}
+//==============================================================================
+class NullTest
+    /* Рендерит детерминированные сигналы через каждый клиппер в угловых
+    значениях параметров и сравнивает быстрые ядра (processBlock и
+    processModulatedBlock) с эталонной посэмпловой реализацией process,
+    а при наличии - с сохранёнными рендерами. */
+{
+public:
+    NullTest(double _tolerance) : tolerance(_tolerance) { }
+
+    bool run(const juce::File& referenceDir, bool writeReference)
+    {
+        const juce::StringArray signalNames{ "sine100", "sine5k", "sweep", "noise", "impulses" };
+        const std::array<double, 4> clipCorners{ 1.0, 1.5, 5.0, 10.0 };
+        const std::array<double, 3> drives{ 0.5, 1.0, 2.0 }; // имитация Input Gain -6, 0, +6 dB
+        bool passed{ true };
+        for (int clipperType = 0; clipperType < clipperNames.size(); ++clipperType)
+        {
+            for (const auto& signalName : signalNames)
+            {
+                for (auto drive : drives)
+                {
+                    const auto input{ generateSignal(signalName, drive) };
+                    for (auto clip : clipCorners)
+                    {
+                        const auto name{ clipperNames[clipperType].removeCharacters(" ") + "_" + signalName
+                                         + "_drive" + juce::String(drive, 1) + "_clip" + juce::String(clip, 1) };
+                        passed &= compareWithOracle<float>(name, clipperType, clip, input);
+                        passed &= compareWithOracle<double>(name, clipperType, clip, input);
+                        passed &= compareModulatedWithOracle<float>(name, clipperType, clip, input, 6.0);
+                        passed &= compareModulatedWithOracle<double>(name, clipperType, clip, input, 6.0);
+                        /* Полный диапазон Sidechain Drive проверяется только в double:
+                        при множителе в 16 раз выше Clip = 10 фаза SineFold во float
+                        теряет точность уже в самом process. */
+                        passed &= compareModulatedWithOracle<double>(name, clipperType, clip, input, SIDECHAIN_MAX_DRIVE_DB);
+                        if (referenceDir != juce::File())
+                        {
+                            passed &= compareWithReference(name, clipperType, clip, input,
+                                                           referenceDir.getChildFile(name + ".wav"), writeReference);
+                        }
+                    }
+                }
+            }
+        }
+        std::cout << numChecks << " checks, " << numFailures << " failures, worst deviation "
+                  << juce::Decibels::gainToDecibels(worstDeviation) << " dBFS" << std::endl;
+        return passed;
+    }
+private:
+    static std::vector<double> generateSignal(const juce::String& name, double amplitude)
+    {
+        const double sampleRate{ 48000.0 };
+        std::vector<double> signal(static_cast<size_t>(sampleRate));
+        juce::Random random{ 0x5eed };
+        double phase{ 0.0 };
+        for (size_t i = 0; i < signal.size(); ++i)
+        {
+            const double time{ static_cast<double>(i) / sampleRate };
+            double value{ 0.0 };
+            if (name == "sine100") { value = std::sin(juce::MathConstants<double>::twoPi * 100.0 * time); }
+            else if (name == "sine5k") { value = std::sin(juce::MathConstants<double>::twoPi * 5000.0 * time); }
+            else if (name == "sweep")
+            {
+                // логарифмический свип 20 Гц - 20 кГц
+                const double frequency{ 20.0 * std::pow(1000.0, static_cast<double>(i) / static_cast<double>(signal.size())) };
+                phase += juce::MathConstants<double>::twoPi * frequency / sampleRate;
+                value = std::sin(phase);
+            }
+            else if (name == "noise") { value = random.nextDouble() * 2.0 - 1.0; }
+            else if (name == "impulses") { value = (i % 4800 == 0) ? 1.0 : 0.0; }
+            signal[i] = value * amplitude;
+        }
+        return signal;
+    }
+
+    template <typename SampleType>
+    bool compareWithOracle(const juce::String& name, int clipperType, double clip, const std::vector<double>& input)
+    {
+        auto clipper{ createClipper<SampleType>(clipperType) };
+        clipper->updateMultiplier(clip);
+        std::vector<SampleType> expected(input.begin(), input.end());
+        std::vector<SampleType> actual(input.begin(), input.end());
+        for (auto& sample : expected) { sample = clipper->process(sample); }
+        clipper->processBlock(actual.data(), static_cast<int>(actual.size()));
+        return check(name + (std::is_same<SampleType, float>::value ? " [float]" : " [double]"), expected, actual);
+    }
+
+    template <typename SampleType>
+    bool compareModulatedWithOracle(const juce::String& name, int clipperType, double clip,
+                                    const std::vector<double>& input, double rangeInDb)
+    {
+        /* Посэмпловое отношение множителей, качающееся в пределах ±rangeInDb
+        как огибающая сайдчейна, против process, которому для каждого сэмпла
+        выставлен Clip с таким множителем: модулированное ядро обязано давать
+        ту же кривую вместе с нормировкой. */
+        auto clipper{ createClipper<SampleType>(clipperType) };
+        auto oracle{ createClipper<SampleType>(clipperType) };
+        clipper->updateMultiplier(clip);
+        const auto baseMultiplier{ clipper->getMultiplier() };
+        const auto multiplierPerClip{ clipper->getMultiplierFor(clip + 1.0) - baseMultiplier };
+        std::vector<SampleType> gains(input.size());
+        std::vector<SampleType> expected(input.begin(), input.end());
+        std::vector<SampleType> actual(input.begin(), input.end());
+        for (size_t i = 0; i < input.size(); ++i)
+        {
+            const auto position{ static_cast<double>(i) / static_cast<double>(input.size()) };
+            gains[i] = static_cast<SampleType>(juce::Decibels::decibelsToGain(rangeInDb * std::sin(juce::MathConstants<double>::twoPi * 3.0 * position)));
+            oracle->updateMultiplier(clip + baseMultiplier * (static_cast<double>(gains[i]) - 1.0) / multiplierPerClip);
+            expected[i] = oracle->process(expected[i]);
+        }
+        clipper->processModulatedBlock(actual.data(), gains.data(), static_cast<int>(actual.size()));
+        return check(name + " [modulated +/-" + juce::String(rangeInDb, 0) + " dB "
+                     + (std::is_same<SampleType, float>::value ? "float]" : "double]"), expected, actual);
+    }
+
+    bool compareWithReference(const juce::String& name, int clipperType, double clip,
+                              const std::vector<double>& input, const juce::File& file, bool writeReference)
+    {
+        auto clipper{ createClipper<float>(clipperType) };
+        clipper->updateMultiplier(clip);
+        juce::AudioBuffer<float> render{ 1, static_cast<int>(input.size()) };
+        for (int i = 0; i < render.getNumSamples(); ++i) { render.setSample(0, i, static_cast<float>(input[static_cast<size_t>(i)])); }
+        clipper->processBlock(render.getWritePointer(0), render.getNumSamples());
+        juce::WavAudioFormat wav;
+        if (writeReference)
+        {
+            file.getParentDirectory().createDirectory();
+            file.deleteFile();
+            std::unique_ptr<juce::AudioFormatWriter> writer{ wav.createWriterFor(new juce::FileOutputStream(file), 48000.0, 1, 32, {}, 0) };
+            return writer != nullptr && writer->writeFromAudioSampleBuffer(render, 0, render.getNumSamples());
+        }
+        std::unique_ptr<juce::AudioFormatReader> reader{ wav.createReaderFor(new juce::FileInputStream(file), true) };
+        if (reader == nullptr)
+        {
+            std::cout << "MISSING  " << name << " (" << file.getFullPathName() << ")" << std::endl;
+            ++numFailures;
+            return false;
+        }
+        juce::AudioBuffer<float> reference{ 1, static_cast<int>(reader->lengthInSamples) };
+        reader->read(&reference, 0, reference.getNumSamples(), 0, true, false);
+        std::vector<float> expected(reference.getReadPointer(0), reference.getReadPointer(0) + reference.getNumSamples());
+        std::vector<float> actual(render.getReadPointer(0), render.getReadPointer(0) + render.getNumSamples());
+        return check(name + " [reference]", expected, actual);
+    }
+
+    template <typename SampleType>
+    bool check(const juce::String& name, const std::vector<SampleType>& expected, const std::vector<SampleType>& actual)
+    {
+        ++numChecks;
+        double deviation{ expected.size() == actual.size() ? 0.0 : 1.0 };
+        for (size_t i = 0; i < juce::jmin(expected.size(), actual.size()); ++i)
+        {
+            deviation = juce::jmax(deviation, std::abs(static_cast<double>(expected[i]) - static_cast<double>(actual[i])));
+        }
+        worstDeviation = juce::jmax(worstDeviation, deviation);
+        if (deviation <= tolerance) { return true; }
+        std::cout << "FAIL     " << name << ": max deviation " << deviation << std::endl;
+        ++numFailures;
+        return false;
+    }
+
+    double tolerance;
+    double worstDeviation{ 0.0 };
+    int numChecks{ 0 };
+    int numFailures{ 0 };
+};
+
+static void runNullTest(const juce::ArgumentList& args)
+{
+    const auto toleranceOption{ args.getValueForOption("--tolerance") };
+    const double tolerance{ toleranceOption.isEmpty() ? 1.0e-5 : toleranceOption.getDoubleValue() };
+    const auto referencePath{ args.getValueForOption(args.containsOption("--write-reference") ? "--write-reference" : "--reference") };
+    const auto referenceDir{ referencePath.isEmpty() ? juce::File()
+                                                     : juce::File::getCurrentWorkingDirectory().getChildFile(referencePath) };
+    NullTest nullTest{ tolerance };
+    if (!nullTest.run(referenceDir, args.containsOption("--write-reference")))
+    {
+        juce::ConsoleApplication::fail("Null test failed", 1);
+    }
+}
+//==============================================================================
+static void runRealtimeSafetyCheck(const juce::ArgumentList& args)
+{
+    /* Гоняет processBlock со случайными размерами блоков, пока управляющий
+    поток автоматизирует параметры и присылает снимки пресетов и морфинга.
+    Любое выделение памяти или захват мьютекса внутри processBlock
+    считается нарушением. */
+   #if ! RT_SAFETY_CHECK
+    juce::ConsoleApplication::fail("This build does not mark the audio thread, rebuild with RT_SAFETY_CHECK=1", 1);
+   #endif
+    // без перехватчиков (сборка с санитайзерами) проверка всегда проходила бы с нулём нарушений
+    if (!RealtimeSafety::isAvailable())
+    {
+        juce::ConsoleApplication::fail("Allocation and lock hooks are not compiled into this build (sanitizer builds "
+                                       "disable them), --rt-check cannot detect anything", 1);
+    }
+    const int numSeconds{ getIntOption(args, "--seconds", 5) };
+    const int maxBlockSize{ getIntOption(args, "--max-block", 2048) };
+    const double sampleRate{ 48000.0 };
+    DestructionAudioProcessor processor;
+    processor.setRateAndBufferSizeDetails(sampleRate, maxBlockSize);
+    processor.prepareToPlay(sampleRate, maxBlockSize);
+    juce::AudioBuffer<float> buffer{ 2, maxBlockSize };
+    juce::MidiBuffer midi;
+    juce::Random random{ 0x44535442 };
+
+    std::atomic<bool> running{ true };
+    std::thread control([&processor, &running]
+    {
+        juce::Random controlRandom{ 0x4d4f5250 };
+        auto randomSnapshot = [&controlRandom]
+        {
+            ParameterSnapshot snapshot;
+            snapshot.inputGainInDb = controlRandom.nextDouble() * 48.0 - 24.0;
+            snapshot.outputGainInDb = controlRandom.nextDouble() * 48.0 - 24.0;
+            snapshot.clip = 1.0 + controlRandom.nextDouble() * 9.0;
+            snapshot.clipperType = controlRandom.nextInt(clipperNames.size());
+            snapshot.linked = controlRandom.nextBool();
+            snapshot.bypassed = controlRandom.nextInt(10) == 0;
+            return snapshot;
+        };
+        const auto& parameters{ processor.getParameters() };
+        while (running)
+        {
+            parameters[controlRandom.nextInt(parameters.size())]->setValueNotifyingHost(controlRandom.nextFloat());
+            switch (controlRandom.nextInt(3))
+            {
+                case 0: processor.presetSnapshots.push(randomSnapshot()); break;
+                case 1: processor.morphFifo.push({ randomSnapshot(), randomSnapshot(), true }); break;
+                default: processor.morphFifo.push({ {}, {}, false }); break;
+            }
+            juce::Thread::sleep(1);
+        }
+    });
+
+    juce::int64 numBlocks{ 0 };
+    RealtimeSafety::startChecking();
+    const auto endTime{ juce::Time::getMillisecondCounterHiRes() + 1000.0 * numSeconds };
+    while (juce::Time::getMillisecondCounterHiRes() < endTime)
+    {
+        const int numSamples{ random.nextInt({ 1, maxBlockSize + 1 }) };
+        buffer.setSize(2, numSamples, false, false, true);
+        const float level{ random.nextFloat() * 2.0f };
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        {
+            auto* channelData{ buffer.getWritePointer(channel) };
+            for (int i = 0; i < numSamples; ++i) { channelData[i] = level * (random.nextFloat() * 2.0f - 1.0f); }
+        }
+        // MIDI-события посреди блока заставляют processBlock резать его на куски
+        midi.clear();
+        for (int event = random.nextInt(4); event > 0; --event)
+        {
+            const auto position{ random.nextInt(numSamples) };
+            if (random.nextBool()) { midi.addEvent(juce::MidiMessage::controllerEvent(1, MIDI_CC_CLIP + random.nextInt(3), random.nextInt(128)), position); }
+            else { midi.addEvent(juce::MidiMessage::noteOn(1, MIDI_NOTE_FIRST_CLIPPER + random.nextInt(13), 1.0f), position); }
+        }
+        processor.processBlock(buffer, midi);
+        ++numBlocks;
+    }
+    const auto reports{ RealtimeSafety::stopChecking() };
+    running = false;
+    control.join();
+
+    std::cout << "Processed " << numBlocks << " blocks of 1.." << maxBlockSize << " samples, "
+              << RealtimeSafety::getNumViolations() << " violations"
+              << (RealtimeSafety::canDetectLocks() ? "" : " (locks are not tracked on this platform)") << std::endl;
+    for (const auto& report : reports) { std::cout << std::endl << report << std::endl; }
+    if (!reports.isEmpty()) { juce::ConsoleApplication::fail("Audio thread allocated or locked inside processBlock", 1); }
+}
+//==============================================================================
+class StressHost
+    /* Имитирует агрессивный хост. Аудиопоток меняет частоту дискретизации
+    и максимальный размер блока между вызовами prepareToPlay и подаёт блоки
+    случайной длины, включая 1 и нечётные. Отдельный поток автоматизирует
+    параметры. Поток сообщений переключает состояния через
+    setStateInformation и открывает и закрывает редактор. Все потоки
+    работают одновременно, чтобы гонки воспроизводились под ThreadSanitizer. */
+{
+public:
+    StressHost(juce::int64 _seed, int _maxBlockSize, bool _useEditor)
+        : seed(_seed), maxBlockSize(_maxBlockSize), useEditor(_useEditor) { }
+
+    bool run(int numSeconds)
+    {
+        DestructionAudioProcessor processor;
+        const auto states{ createStates() };
+        running = true;
+        std::thread audio([this, &processor] { runAudio(processor); });
+        std::thread automation([this, &processor] { runAutomation(processor); });
+
+        juce::Random random{ seed + 2 };
+        std::unique_ptr<juce::AudioProcessorEditor> editor;
+        const auto endTime{ juce::Time::getMillisecondCounterHiRes() + 1000.0 * numSeconds };
+        while (juce::Time::getMillisecondCounterHiRes() < endTime)
+        {
+            juce::MessageManager::getInstance()->runDispatchLoopUntil(random.nextInt({ 1, 20 }));
+            const auto& state{ states.getReference(random.nextInt(states.size())) };
+            processor.setStateInformation(state.getData(), static_cast<int>(state.getSize()));
+            ++numStateChanges;
+            if (useEditor && random.nextInt(8) == 0)
+            {
+                if (editor == nullptr) { editor.reset(processor.createEditorIfNeeded()); ++numEditorOpens; }
+                else { editor.reset(); }
+            }
+        }
+        editor.reset();
+        running = false;
+        audio.join();
+        automation.join();
+        const bool stateDelivered{ checkStateDelivery(processor, states) };
+        printSummary();
+        if (!stateDelivered) { std::cout << "setStateInformation did not reach the audio thread" << std::endl; }
+        return numNonFinite == 0 && stateDelivered;
+    }
+
+private:
+    juce::Array<juce::MemoryBlock> createStates() const
+    {
+        // набор случайных состояний, между которыми «хост» переключается как между программами
+        DestructionAudioProcessor source;
+        juce::Random random{ seed + 1 };
+        juce::Array<juce::MemoryBlock> states;
+        for (int i = 0; i < 16; ++i)
+        {
+            for (auto* parameter : source.getParameters()) { parameter->setValueNotifyingHost(random.nextFloat()); }
+            juce::MemoryBlock state;
+            source.getStateInformation(state);
+            states.add(state);
+        }
+        return states;
+    }
+
+    bool checkStateDelivery(DestructionAudioProcessor& processor, const juce::Array<juce::MemoryBlock>& states) const
+    {
+        /* Регрессия: setStateInformation только ставит снимок в очередь,
+        а применяет его аудиопоток. После одного блока тип клиппера
+        и байпас должны совпадать с загруженным состоянием. */
+        juce::AudioBuffer<float> buffer{ 2, 64 };
+        juce::MidiBuffer midi;
+        processor.setRateAndBufferSizeDetails(48000.0, buffer.getNumSamples());
+        processor.prepareToPlay(48000.0, buffer.getNumSamples());
+        for (const auto& state : states)
+        {
+            processor.setStateInformation(state.getData(), static_cast<int>(state.getSize()));
+            buffer.clear();
+            processor.processBlock(buffer, midi);
+            const auto clipperType{ static_cast<int>(processor.apvts.getRawParameterValue("Clipper Type")->load()) };
+            const bool bypassed{ processor.apvts.getRawParameterValue("Bypass")->load() >= 0.5f };
+            if (processor.clipHolder.getClipper() != processor.clipHolder.getClipper(clipperType)
+                || processor.gainController.getBypassState() != bypassed) { return false; }
+        }
+        return true;
+    }
+
+    void runAudio(DestructionAudioProcessor& processor)
+    {
+        static const std::array<double, 5> sampleRates{ 44100.0, 48000.0, 88200.0, 96000.0, 192000.0 };
+        juce::Random random{ seed };
+        juce::AudioBuffer<float> buffer;
+        juce::MidiBuffer midi;
+        std::array<float, 2> lastSample{};
+        double phase{ 0.0 };
+        while (running)
+        {
+            const double sampleRate{ sampleRates[static_cast<size_t>(random.nextInt(static_cast<int>(sampleRates.size())))] };
+            const int preparedBlockSize{ random.nextInt({ 1, maxBlockSize + 1 }) };
+            processor.releaseResources();
+            processor.setRateAndBufferSizeDetails(sampleRate, preparedBlockSize);
+            processor.prepareToPlay(sampleRate, preparedBlockSize);
+            buffer.setSize(2, preparedBlockSize);
+            ++numPrepares;
+            const double phaseIncrement{ juce::MathConstants<double>::twoPi * random.nextInt({ 40, 400 }) / sampleRate };
+            float previousMaxStep{ 0.0f };
+            for (int block = random.nextInt({ 16, 512 }); block > 0 && running; --block)
+            {
+                int numSamples{ random.nextInt({ 1, preparedBlockSize + 1 }) };
+                if (random.nextInt(10) == 0) { numSamples = 1; }
+                buffer.setSize(2, numSamples, false, false, true);
+                for (int i = 0; i < numSamples; ++i)
+                {
+                    const auto sample{ static_cast<float>(0.5 * std::sin(phase)) };
+                    buffer.setSample(0, i, sample);
+                    buffer.setSample(1, i, sample);
+                    phase = std::fmod(phase + phaseIncrement, juce::MathConstants<double>::twoPi);
+                }
+                const auto start{ juce::Time::getHighResolutionTicks() };
+                processor.processBlock(buffer, midi);
+                const auto elapsedUs{ ticksToMicroseconds(juce::Time::getHighResolutionTicks() - start) };
+                const auto budgetUs{ 1.0e6 * numSamples / sampleRate };
+                if (elapsedUs / budgetUs > worstLoad)
+                {
+                    worstLoad = elapsedUs / budgetUs;
+                    worstLoadDescription = juce::String(elapsedUs, 1) + " us for " + juce::String(numSamples)
+                                         + " samples at " + juce::String(sampleRate, 0) + " Hz";
+                }
+                worstBlockUs = juce::jmax(worstBlockUs, elapsedUs);
+                ++numBlocks;
+                previousMaxStep = checkOutput(buffer, lastSample, previousMaxStep);
+            }
+        }
+    }
+
+    float checkOutput(const juce::AudioBuffer<float>& buffer, std::array<float, 2>& lastSample, float previousMaxStep)
+    {
+        /* Скачок на границе блока считается разрывом, если он заметно больше
+        самого крупного шага внутри соседних блоков. Такие щелчки и ищутся
+        в «неудобных» хостах. */
+        float maxStep{ 0.0f };
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        {
+            const auto* channelData{ buffer.getReadPointer(channel) };
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+            {
+                if (!std::isfinite(channelData[i]))
+                {
+                    if (numNonFinite++ == 0) { DBG("Non-finite output in block " << numBlocks); }
+                    return previousMaxStep;
+                }
+                if (i > 0) { maxStep = juce::jmax(maxStep, std::abs(channelData[i] - channelData[i - 1])); }
+            }
+            const auto boundaryStep{ std::abs(channelData[0] - lastSample[static_cast<size_t>(channel)]) };
+            if (boundaryStep > juce::jmax(0.25f, 4.0f * juce::jmax(maxStep, previousMaxStep))) { ++numDiscontinuities; }
+            lastSample[static_cast<size_t>(channel)] = channelData[buffer.getNumSamples() - 1];
+        }
+        return maxStep;
+    }
+
+    void runAutomation(DestructionAudioProcessor& processor)
+    {
+        juce::Random random{ seed + 3 };
+        const auto& parameters{ processor.getParameters() };
+        while (running)
+        {
+            parameters[random.nextInt(parameters.size())]->setValueNotifyingHost(random.nextFloat());
+            ++numAutomationEvents;
+            juce::Thread::sleep(random.nextInt(3));
+        }
+    }
+
+    void printSummary() const
+    {
+        std::cout << "Seed " << seed << ": " << numBlocks << " blocks, " << numPrepares << " prepareToPlay calls, "
+                  << numAutomationEvents << " automation events, " << numStateChanges << " state changes, "
+                  << numEditorOpens << " editor opens" << std::endl;
+        std::cout << "Worst block time " << juce::String(worstBlockUs, 1) << " us, worst load "
+                  << juce::String(100.0 * worstLoad, 1) << "% of the block duration (" << worstLoadDescription << ")" << std::endl;
+        std::cout << "Non-finite samples " << numNonFinite << ", block boundary discontinuities "
+                  << numDiscontinuities << std::endl;
+    }
+
+    const juce::int64 seed;
+    const int maxBlockSize;
+    const bool useEditor;
+    std::atomic<bool> running{ false };
+    // пишутся аудиопотоком и читаются после его завершения
+    juce::int64 numBlocks{ 0 };
+    int numPrepares{ 0 };
+    double worstBlockUs{ 0.0 };
+    double worstLoad{ 0.0 };
+    juce::String worstLoadDescription;
+    int numNonFinite{ 0 };
+    int numDiscontinuities{ 0 };
+    std::atomic<int> numAutomationEvents{ 0 };
+    int numStateChanges{ 0 };
+    int numEditorOpens{ 0 };
+};
+
+static void runStressTest(const juce::ArgumentList& args)
+{
+    const auto seedOption{ args.getValueForOption("--seed") };
+    const juce::int64 seed{ seedOption.isEmpty() ? juce::Time::currentTimeMillis() : seedOption.getLargeIntValue() };
+    StressHost host{ seed, getIntOption(args, "--max-block", 4096), !args.containsOption("--no-editor") };
+    if (!host.run(getIntOption(args, "--seconds", 10)))
+    {
+        juce::ConsoleApplication::fail("Processor produced NaN or Inf samples or lost a host state", 1);
+    }
+}
+//==============================================================================
+static void runHarmonicAnalysis(const juce::ArgumentList& args)
+{
+    /* Таблица искажений для всех ClipperType и значений Clip. Пары
+    (тип, Clip) раздаются рабочим потокам через атомарный счётчик,
+    у каждого потока свой HarmonicAnalyzer. */
+    const auto clipValues{ getIntListOption(args, "--clip", { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 }) };
+    const int numThreads{ getIntOption(args, "--threads", juce::SystemStats::getNumCpus()) };
+    std::vector<std::pair<int, double>> jobs;
+    for (int clipperType = 0; clipperType < clipperNames.size(); ++clipperType)
+    {
+        for (auto clip : clipValues) { jobs.push_back({ clipperType, static_cast<double>(clip) }); }
+    }
+    std::vector<HarmonicReport> reports(jobs.size());
+    std::atomic<size_t> nextJob{ 0 };
+    const auto startTicks{ juce::Time::getHighResolutionTicks() };
+    std::vector<std::thread> workers;
+    for (int i = 0; i < juce::jmin(numThreads, static_cast<int>(jobs.size())); ++i)
+    {
+        workers.emplace_back([&jobs, &reports, &nextJob]()
+        {
+            HarmonicAnalyzer analyzer;
+            for (auto job{ nextJob++ }; job < jobs.size(); job = nextJob++)
+            {
+                reports[job] = analyzer.analyse(jobs[job].first, jobs[job].second);
+            }
+        });
+    }
+    for (auto& worker : workers) { worker.join(); }
+    const auto elapsedMs{ 0.001 * ticksToMicroseconds(juce::Time::getHighResolutionTicks() - startTicks) };
+
+    if (args.containsOption("--json"))
+    {
+        juce::Array<juce::var> entries;
+        for (const auto& report : reports)
+        {
+            auto* entry{ new juce::DynamicObject() };
+            entry->setProperty("clipper", clipperNames[report.clipperType]);
+            entry->setProperty("clip", report.clip);
+            entry->setProperty("fundamentalDb", report.fundamentalInDb);
+            entry->setProperty("thd", report.thd);
+            entry->setProperty("aliasDb", report.aliasInDb);
+            juce::Array<juce::var> harmonics;
+            for (auto level : report.harmonicsInDb) { harmonics.add(level); }
+            entry->setProperty("harmonicsDb", harmonics);
+            entries.add(juce::var(entry));
+        }
+        auto* root{ new juce::DynamicObject() };
+        root->setProperty("benchmark", "thd");
+        root->setProperty("testFrequency", HarmonicAnalyzer::getTestFrequency());
+        root->setProperty("testAmplitude", HARMONIC_TEST_AMPLITUDE);
+        root->setProperty("sampleRate", HARMONIC_SAMPLE_RATE);
+        root->setProperty("results", entries);
+        const auto json{ juce::JSON::toString(juce::var(root)) };
+        const auto outputPath{ args.getValueForOption("--output") };
+        if (outputPath.isEmpty()) { std::cout << json << std::endl; }
+        else { juce::File::getCurrentWorkingDirectory().getChildFile(outputPath).replaceWithText(json); }
+        return;
+    }
+
+    std::cout << "test tone " << juce::String(HarmonicAnalyzer::getTestFrequency(), 1) << " Hz at "
+              << juce::String(juce::Decibels::gainToDecibels(HARMONIC_TEST_AMPLITUDE), 1) << " dBFS, "
+              << juce::String(HARMONIC_SAMPLE_RATE * 0.001, 1) << " kHz; harmonics and alias in dBc; "
+              << reports.size() << " settings in " << juce::String(elapsedMs, 1) << " ms on "
+              << workers.size() << " threads" << std::endl;
+    std::cout << "clipper      clip    THD %  alias";
+    for (int order = 2; order <= HARMONIC_MAX_ORDER; ++order) { std::cout << ("H" + juce::String(order)).paddedLeft(' ', 5); }
+    std::cout << std::endl;
+    for (const auto& report : reports)
+    {
+        std::cout << clipperNames[report.clipperType].paddedRight(' ', 12)
+                  << juce::String(report.clip, 1).paddedLeft(' ', 5)
+                  << juce::String(report.thd * 100.0, 2).paddedLeft(' ', 9)
+                  << juce::String(juce::roundToInt(report.aliasInDb)).paddedLeft(' ', 7);
+        for (auto level : report.harmonicsInDb) { std::cout << juce::String(juce::roundToInt(level)).paddedLeft(' ', 5); }
+        std::cout << std::endl;
+    }
+}
+//==============================================================================
+static juce::int64 getResidentMemoryInKilobytes()
+{
+   #if JUCE_LINUX
+    juce::StringArray lines;
+    lines.addLines(juce::File("/proc/self/status").loadFileAsString());
+    for (const auto& line : lines)
+    {
+        if (line.startsWith("VmRSS:")) { return line.fromFirstOccurrenceOf(":", false, false).trim().getLargeIntValue(); }
+    }
+   #endif
+    return -1;
+}
+
+static void runMemoryReport(const juce::ArgumentList& args)
+{
+    /* Показывает прирост резидентной памяти на экземпляр: сразу после
+    создания, после prepareToPlay и с открытым окном. Общие ресурсы
+    (гарнитура, логотип, таблица кривой) создаются один раз, поэтому
+    прирост на экземпляр меньше, чем у первого экземпляра. */
+    const int numInstances{ getIntOption(args, "--instances", 100) };
+    const bool useEditor{ !args.containsOption("--no-editor") };
+    if (getResidentMemoryInKilobytes() < 0)
+    {
+        std::cout << "Resident memory is only reported on Linux" << std::endl;
+        return;
+    }
+    std::vector<std::unique_ptr<DestructionAudioProcessor>> instances;
+    std::vector<std::unique_ptr<juce::AudioProcessorEditor>> editors;
+    auto report = [&, previous = getResidentMemoryInKilobytes()](const juce::String& stage) mutable
+    {
+        const auto current{ getResidentMemoryInKilobytes() };
+        std::cout << stage.paddedRight(' ', 14)
+                  << juce::String(current).paddedLeft(' ', 10) << " KB total"
+                  << juce::String(static_cast<double>(current - previous) / numInstances, 1).paddedLeft(' ', 10) << " KB/instance"
+                  << std::endl;
+        previous = current;
+    };
+
+    std::cout << "Resident memory (" << numInstances << " instances)" << std::endl;
+    report("baseline");
+    for (int i = 0; i < numInstances; ++i) { instances.push_back(std::make_unique<DestructionAudioProcessor>()); }
+    report("constructed");
+    for (auto& instance : instances) { instance->prepareToPlay(48000.0, 512); }
+    report("prepared");
+    if (useEditor)
+    {
+        for (auto& instance : instances) { editors.emplace_back(instance->createEditorIfNeeded()); }
+        juce::MessageManager::getInstance()->runDispatchLoopUntil(100);
+        report("editors open");
+        editors.clear(); // окна удаляются раньше процессоров
+    }
+    for (auto& instance : instances) { instance->releaseResources(); }
+}
+//==============================================================================
+static void runEditorOpenBenchmark(const juce::ArgumentList& args)
+{
+    /* Открывает и закрывает окно, как хост по щелчку на слоте плагина.
+    Первый кадр рисуется в изображение, затем цикл сообщений отдаёт
+    отложенную работу. Превышение EDITOR_OPEN_BUDGET_MS - ошибка. */
+    const int numIterations{ juce::jmax(1, getIntOption(args, "--iterations", 50)) };
+    DestructionAudioProcessor processor;
+    processor.prepareToPlay(48000.0, 512);
+    EditorOpenTiming average;
+    EditorOpenTiming worst;
+    for (int iteration = 0; iteration < numIterations; ++iteration)
+    {
+        std::unique_ptr<juce::AudioProcessorEditor> editor{ processor.createEditorIfNeeded() };
+        editor->createComponentSnapshot(editor->getLocalBounds());
+        juce::MessageManager::getInstance()->runDispatchLoopUntil(20);
+        const auto timing{ dynamic_cast<DestructionAudioProcessorEditor&>(*editor).getOpenTiming() };
+        average.constructionMs += timing.constructionMs / numIterations;
+        average.firstFrameMs += timing.firstFrameMs / numIterations;
+        average.deferredMs += timing.deferredMs / numIterations;
+        worst.constructionMs = juce::jmax(worst.constructionMs, timing.constructionMs);
+        worst.firstFrameMs = juce::jmax(worst.firstFrameMs, timing.firstFrameMs);
+        worst.deferredMs = juce::jmax(worst.deferredMs, timing.deferredMs);
+    }
+    processor.releaseResources();
+
+    auto print = [](const juce::String& name, double averageMs, double worstMs)
+    {
+        std::cout << name.paddedRight(' ', 14)
+                  << juce::String(averageMs, 2).paddedLeft(' ', 10) << " ms avg"
+                  << juce::String(worstMs, 2).paddedLeft(' ', 10) << " ms max" << std::endl;
+    };
+    std::cout << "Editor open time (" << numIterations << " opens, budget "
+              << juce::String(EDITOR_OPEN_BUDGET_MS, 1) << " ms to first frame)" << std::endl;
+    print("construction", average.constructionMs, worst.constructionMs);
+    print("first frame", average.firstFrameMs, worst.firstFrameMs);
+    print("deferred", average.deferredMs, worst.deferredMs);
+    if (worst.firstFrameMs > EDITOR_OPEN_BUDGET_MS)
+    {
+        juce::ConsoleApplication::fail("First frame exceeded the editor open budget", 1);
+    }
+}
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    juce::ConsoleApplication app;
+    app.addHelpCommand("--help|-h", "Usage:", true);
+    app.addCommand({ "--state",
+                     "--state [--instances=N] [--iterations=N]",
+                     "Measures plugin state save/restore time per instance",
+                     "Compares the compact binary state format with the legacy XML format.",
+                     [](const juce::ArgumentList& args) { runStateBenchmark(args); } });
+    app.addCommand({ "--dsp",
+                     "--dsp [--clip=1,3,5,10] [--blocks=16,64,256,1024,4096] [--channels=1,2] [--samples=N] [--passes=N] [--stages=1,0] [--json [--output=file]]",
+                     "Measures the clipper kernels and processBlock",
+                     "Reports ns/sample, cycles/sample and throughput for every ClipperType, Clip value, block size, "
+                     "channel count and sample type. --stages=1,0 instead compares a clipping chain of the given ClipperType indices "
+                     "fused in one instance against the same chain built from separate instances. "
+                     "--json prints machine-readable results for regression tracking.",
+                     [](const juce::ArgumentList& args) { runDspBenchmark(args); } });
+    app.addCommand({ "--null",
+                     "--null [--tolerance=1e-5] [--reference=dir | --write-reference=dir]",
+                     "Null-tests the fast clipper kernels against the scalar reference",
+                     "Renders sines, a sweep, noise and impulses through every clipper at parameter corners. "
+                     "Fails with a non-zero exit code if processBlock deviates from process, or from stored renders, "
+                     "by more than the tolerance.",
+                     [](const juce::ArgumentList& args) { runNullTest(args); } });
+    app.addCommand({ "--rt-check",
+                     "--rt-check [--seconds=N] [--max-block=N]",
+                     "Checks that processBlock neither allocates nor locks",
+                     "Drives the processor with randomized block sizes, parameter automation, preset snapshots and morphing "
+                     "while allocation and mutex calls are intercepted. Prints the call stack of every distinct violation "
+                     "and fails with a non-zero exit code if any were found.",
+                     [](const juce::ArgumentList& args) { runRealtimeSafetyCheck(args); } });
+    app.addCommand({ "--stress",
+                     "--stress [--seconds=N] [--seed=N] [--max-block=N] [--no-editor]",
+                     "Hosts the processor like an aggressive host",
+                     "Re-prepares with random sample rates and block sizes, processes random block lengths including 1 "
+                     "while another thread automates parameters and the message thread switches states and opens and "
+                     "closes the editor. Reports the worst block time, NaN/Inf samples and block boundary "
+                     "discontinuities; fails on NaN/Inf. Pass the printed seed to reproduce a run. On Linux build with "
+                     "CXXFLAGS=-fsanitize=thread LDFLAGS=-fsanitize=thread to run it under ThreadSanitizer.",
+                     [](const juce::ArgumentList& args) { runStressTest(args); } });
+    app.addCommand({ "--thd",
+                     "--thd [--clip=1,2,...,10] [--threads=N] [--json [--output=file]]",
+                     "Dumps THD, harmonics and alias content for every clipper setting",
+                     "Renders a bin-exact test tone through every ClipperType at every Clip value in parallel and reports "
+                     "THD over harmonics 2 to 20, the level of each of those harmonics and the power of aliased components, "
+                     "both relative to the fundamental. --json prints machine-readable results.",
+                     [](const juce::ArgumentList& args) { runHarmonicAnalysis(args); } });
+    app.addCommand({ "--memory",
+                     "--memory [--instances=N] [--no-editor]",
+                     "Reports resident memory per plugin instance",
+                     "Creates N processors, prepares them at 48 kHz with 512-sample blocks and opens an editor for each, "
+                     "printing the resident memory growth per instance after every stage. Linux only.",
+                     [](const juce::ArgumentList& args) { runMemoryReport(args); } });
+    app.addCommand({ "--editor",
+                     "--editor [--iterations=N]",
+                     "Measures editor open time",
+                     "Opens and closes the editor N times and reports construction time, time to the first painted frame "
+                     "and the work deferred past it. Fails with a non-zero exit code if the first frame exceeds "
+                     "EDITOR_OPEN_BUDGET_MS.",
+                     [](const juce::ArgumentList& args) { runEditorOpenBenchmark(args); } });
+    return app.findAndRunCommand(argc, argv);
+}
@@ -0,0 +1,150 @@
+/*
+  ==============================================================================
+
+    Real-time safety checker: reports allocations and locks made
+    by the audio thread inside processBlock.
+
+  ==============================================================================
+*/
+
+#include "RealtimeSafety.h"
+#include "../../Source/PluginProcessor.h"
+#if JUCE_LINUX
+    #include <dlfcn.h>
+    #include <pthread.h>
+#endif
+// санитайзеры сами перехватывают malloc и мьютексы, с ними наши перехватчики отключаются
+#if defined(__SANITIZE_THREAD__) || defined(__SANITIZE_ADDRESS__)
+    #define RT_SAFETY_HOOKS 0
+#elif defined(__has_feature)
+    #if __has_feature(thread_sanitizer) || __has_feature(address_sanitizer)
+        #define RT_SAFETY_HOOKS 0
+    #endif
+#endif
+#ifndef RT_SAFETY_HOOKS
+    #define RT_SAFETY_HOOKS 1
+#endif
+//==============================================================================
+namespace
+{
+    std::atomic<bool> checking{ false };
+    std::atomic<int> numViolations{ 0 };
+    thread_local bool reporting{ false };
+    juce::CriticalSection reportLock;
+    juce::StringArray reports;
+
+    void reportViolation(const char* call)
+    {
+        if (!checking.load(std::memory_order_relaxed) || reporting || !RealtimeScope::isActive()) { return; }
+        // сам отчёт выделяет память и берёт мьютекс, поэтому перехват на это время отключается
+        reporting = true;
+        ++numViolations;
+        {
+            const juce::ScopedLock lock(reportLock);
+            reports.addIfNotAlreadyThere(juce::String(call) + " inside processBlock\n" + juce::SystemStats::getStackBacktrace());
+        }
+        reporting = false;
+    }
+}
+//==============================================================================
+#if RT_SAFETY_HOOKS && JUCE_LINUX
+/* На Linux перехватываются malloc/free из glibc, через которые проходят
+и operator new, и HeapBlock внутри AudioBuffer, а также pthread_mutex_lock,
+на котором построены CriticalSection и std::mutex. */
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* pointer, size_t size);
+    void __libc_free(void* pointer);
+
+    void* malloc(size_t size)
+    {
+        reportViolation("malloc");
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        reportViolation("calloc");
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* pointer, size_t size)
+    {
+        reportViolation("realloc");
+        return __libc_realloc(pointer, size);
+    }
+
+    void free(void* pointer)
+    {
+        if (pointer != nullptr) { reportViolation("free"); }
+        __libc_free(pointer);
+    }
+
+    int pthread_mutex_lock(pthread_mutex_t* mutex)
+    {
+        using LockFunction = int (*)(pthread_mutex_t*);
+        static auto realLock{ reinterpret_cast<LockFunction>(dlsym(RTLD_NEXT, "pthread_mutex_lock")) };
+        reportViolation("pthread_mutex_lock");
+        return realLock(mutex);
+    }
+}
+#elif RT_SAFETY_HOOKS
+/* На остальных платформах перехватываются только глобальные operator new
+и operator delete. Блокировки и прямые вызовы malloc не отслеживаются. */
+void* operator new(std::size_t size)
+{
+    reportViolation("operator new");
+    if (auto* pointer{ std::malloc(size == 0 ? 1 : size) }) { return pointer; }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return ::operator new(size); }
+
+void operator delete(void* pointer) noexcept
+{
+    if (pointer != nullptr) { reportViolation("operator delete"); }
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept { ::operator delete(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { ::operator delete(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { ::operator delete(pointer); }
+#endif
+//==============================================================================
+namespace RealtimeSafety
+{
+    bool isAvailable()
+    {
+        return RT_SAFETY_HOOKS != 0;
+    }
+
+    bool canDetectLocks()
+    {
+       #if RT_SAFETY_HOOKS && JUCE_LINUX
+        return true;
+       #else
+        return false;
+       #endif
+    }
+
+    void startChecking()
+    {
+        {
+            const juce::ScopedLock lock(reportLock);
+            reports.clear();
+        }
+        numViolations = 0;
+        checking = true;
+    }
+
+    juce::StringArray stopChecking()
+    {
+        checking = false;
+        const juce::ScopedLock lock(reportLock);
+        return reports;
+    }
+
+    int getNumViolations() { return numViolations.load(); }
+}
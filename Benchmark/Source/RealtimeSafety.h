@@ -0,0 +1,25 @@
+/*
+  ==============================================================================
+
+    Real-time safety checker: reports allocations and locks made
+    by the audio thread inside processBlock.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+//==============================================================================
+namespace RealtimeSafety
+{
+    /* Перехватчики выделения памяти и мьютексов живут только в этой утилите,
+    плагин лишь отмечает аудиопоток через REALTIME_SCOPE. Пока проверка
+    включена, каждый перехваченный вызов внутри processBlock сохраняется
+    вместе со стеком вызовов, одинаковые стеки схлопываются. */
+    bool isAvailable();
+    bool canDetectLocks();
+    void startChecking();
+    juce::StringArray stopChecking();
+    int getNumViolations();
+}
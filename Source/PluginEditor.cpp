@@ -11,7 +11,7 @@
 //==============================================================================
 XcytheLookAndFeel_v1::XcytheLookAndFeel_v1()
 {
-    font = juce::Typeface::createSystemTypefaceFor(BinaryData::MagistralTT_ttf, BinaryData::MagistralTT_ttfSize);
+    font = juce::Font(resources->getTypeface());
     font.setHeight(FONT_HEIGHT);
 }
 
@@ -313,12 +313,148 @@ void XcytheRotarySlider::resized()
     slider.setBounds(bounds);
 }
 //==============================================================================
+TransientFunctionGraph::~TransientFunctionGraph()
+{
+    if (audioProcessor != nullptr) { audioProcessor->apvts.state.removeListener(this); }
+}
+
 void TransientFunctionGraph::initialize(Clipper<float>* clipper) { currentClipper = clipper; }
 
+void TransientFunctionGraph::attachCustomCurve(DestructionAudioProcessor& processor)
+{
+    audioProcessor = &processor;
+    customCurve = processor.getCustomCurve();
+    processor.apvts.state.addListener(this);
+}
+
+bool TransientFunctionGraph::isEditingCustomCurve() const
+{
+    return audioProcessor != nullptr && currentClipper == audioProcessor->clipHolder.getCustomClipper();
+}
+
+juce::Rectangle<float> TransientFunctionGraph::getGraphBounds() const
+{
+    return getLocalBounds().toFloat().withTrimmedTop(LABEL_HEIGHT).reduced(cornerSize);
+}
+
+juce::Point<float> TransientFunctionGraph::curveToScreen(juce::Point<float> point, bool mirrored) const
+{
+    const auto bounds{ getGraphBounds() };
+    if (mirrored) { point = -point; }
+    return { juce::jmap(point.x, -1.0f, 1.0f, bounds.getX(), bounds.getRight()),
+             juce::jmap(point.y, -1.0f, 1.0f, bounds.getBottom(), bounds.getY()) };
+}
+
+juce::Point<float> TransientFunctionGraph::screenToCurve(juce::Point<float> position) const
+{
+    // левая половина графика - отражение правой, поэтому точка приводится к положительной четверти
+    const auto bounds{ getGraphBounds() };
+    juce::Point<float> point{ juce::jmap(position.x, bounds.getX(), bounds.getRight(), -1.0f, 1.0f),
+                              juce::jmap(position.y, bounds.getBottom(), bounds.getY(), -1.0f, 1.0f) };
+    if (point.x < 0.0f) { point = -point; }
+    return { juce::jlimit(0.0f, 1.0f, point.x), juce::jlimit(0.0f, 1.0f, point.y) };
+}
+
+int TransientFunctionGraph::findPointAt(juce::Point<float> position) const
+{
+    const float grabRadius{ 8.0f };
+    const auto& points{ customCurve.getPoints() };
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        if (curveToScreen(points[i], false).getDistanceFrom(position) < grabRadius
+            || curveToScreen(points[i], true).getDistanceFrom(position) < grabRadius)
+        {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+void TransientFunctionGraph::mouseDown(const juce::MouseEvent& event)
+{
+    if (!isEditingCustomCurve()) { return; }
+    draggedPoint = findPointAt(event.position);
+}
+
+void TransientFunctionGraph::mouseDrag(const juce::MouseEvent& event)
+{
+    if (!isEditingCustomCurve() || draggedPoint <= 0) { return; } // точка в нуле закреплена
+    auto points{ customCurve.getPoints() };
+    const auto index{ static_cast<size_t>(draggedPoint) };
+    auto newPoint{ screenToCurve(event.position) };
+    if (index + 1 < points.size())
+    {
+        // точка не может обогнать соседей по x, иначе сортировка поменяет индексы при перетаскивании
+        newPoint.x = juce::jlimit(points[index - 1].x + 0.01f, points[index + 1].x - 0.01f, newPoint.x);
+    }
+    else { newPoint.x = 1.0f; }
+    points[index] = newPoint;
+    customCurve.setPoints(points);
+    audioProcessor->setCustomCurve(customCurve);
+    update();
+}
+
+void TransientFunctionGraph::mouseUp(const juce::MouseEvent&) { draggedPoint = -1; }
+
+void TransientFunctionGraph::mouseDoubleClick(const juce::MouseEvent& event)
+{
+    if (!isEditingCustomCurve()) { return; }
+    auto points{ customCurve.getPoints() };
+    const int index{ findPointAt(event.position) };
+    if (index > 0 && index + 1 < static_cast<int>(points.size()))
+    {
+        points.erase(points.begin() + index);
+    }
+    else if (index < 0 && points.size() < TransferCurve::maxNumPoints)
+    {
+        points.push_back(screenToCurve(event.position));
+    }
+    else { return; }
+    customCurve.setPoints(points);
+    audioProcessor->setCustomCurve(customCurve);
+    update();
+}
+
+void TransientFunctionGraph::valueTreeRedirected(juce::ValueTree&)
+{
+    // загружен пресет или состояние хоста
+    customCurve = audioProcessor->getCustomCurve();
+    update();
+}
+
 void TransientFunctionGraph::update() { needUpdate = true; }
 
+void TransientFunctionGraph::setHarmonicKey(int clipperType, double clip)
+{
+    if (clipperType == harmonicClipperType && clip == harmonicClip) { return; }
+    harmonicClipperType = clipperType;
+    harmonicClip = clip;
+    needHarmonicReport = true; // прежний результат показывается, пока не готов новый
+}
+
 void TransientFunctionGraph::timerCallback()
 {
+    TRACE_SCOPE("TransientFunctionGraph::timerCallback");
+    if (!bkgd.isValid() && !getLocalBounds().isEmpty()) { drawBackground(); }
+    if (audioProcessor != nullptr)
+    {
+        auto& analysis{ audioProcessor->getHarmonicAnalysis() };
+        if (analysis.getGeneration() != harmonicGeneration)
+        {
+            harmonicGeneration = analysis.getGeneration();
+            needHarmonicReport = true;
+        }
+        if (needHarmonicReport)
+        {
+            if (analysis.getReport(harmonicClipperType, harmonicClip, harmonicReport))
+            {
+                needHarmonicReport = false;
+                harmonicReportValid = true;
+                needUpdate = true;
+            }
+            else { analysis.request(harmonicClipperType, harmonicClip); }
+        }
+    }
     if (needUpdate)
     {
         needUpdate = false;
@@ -330,16 +466,18 @@ void TransientFunctionGraph::timerCallback()
 void TransientFunctionGraph::drawBackground()
 {
     // рендеринг статических данных в изображение для вызова в paint
-    auto bounds{ getLocalBounds().toFloat() };
+    auto bounds{ getLocalBounds().toFloat().withTrimmedTop(LABEL_HEIGHT) };
     bkgd = juce::Image(juce::Image::PixelFormat::ARGB,
-                       static_cast<int>(bounds.getWidth()),
-                       static_cast<int>(bounds.getHeight()),
+                       juce::jmax(1, static_cast<int>(bounds.getWidth())),
+                       juce::jmax(1, static_cast<int>(bounds.getHeight())),
                        true);
     juce::Graphics g{ bkgd }; // сначала создаём изображение с баундами
-    bounds.reduce(lineThickness * 0.5f, lineThickness * 0.5f); // затем режем баунды по толщине линии, чтобы влез контур
-    g.addTransform(juce::AffineTransform::scale(juce::Desktop::getInstance().getGlobalScaleFactor()));
-    g.setColour(juce::Colours::transparentWhite);
-    g.fillAll();
+    drawFrame(g, bounds.withPosition(0.0f, 0.0f));
+}
+
+void TransientFunctionGraph::drawFrame(juce::Graphics& g, juce::Rectangle<float> bounds) const
+{
+    bounds.reduce(lineThickness * 0.5f, lineThickness * 0.5f); // режем баунды по толщине линии, чтобы влез контур
     g.setColour(juce::Colours::black);
     g.fillRoundedRectangle(bounds, cornerSize);
     g.setColour(juce::Colours::darkgrey);
@@ -351,8 +489,11 @@ void TransientFunctionGraph::drawBackground()
 
 void TransientFunctionGraph::paint(juce::Graphics& g)
 {
+    TRACE_SCOPE("TransientFunctionGraph::paint");
     auto bounds{ getLocalBounds().toFloat().withTrimmedTop(LABEL_HEIGHT) };
-    g.drawImage(bkgd, bounds);
+    // до первого тика таймера после открытия окна растра ещё нет, фон рисуется напрямую
+    if (bkgd.isValid()) { g.drawImageAt(bkgd, 0, LABEL_HEIGHT); }
+    else { drawFrame(g, bounds); }
     bounds.reduce(cornerSize, cornerSize);
     int resolution{ 400 }; // кратна ширине графика передаточной функции
     float x{ 0.0f };
@@ -360,11 +501,14 @@ void TransientFunctionGraph::paint(juce::Graphics& g)
     float normalizedX{ 0.0f };
     float normalizedY{ 0.0f };
     juce::Path graph;
+    const bool customCurveShown{ isEditingCustomCurve() };
     for (int i = 0; i < resolution; ++i)
     {
         x = static_cast<float>(i);
         normalizedX = juce::jmap(x, 0.0f, static_cast<float>(resolution) - 1.0f, -1.0f, 1.0f);
-        y = currentClipper->process(normalizedX);
+        // таблицу Custom читает аудиопоток, поэтому график строится по самой кривой, без учёта Clip
+        if (customCurveShown) { y = std::copysign(customCurve.evaluate(std::abs(normalizedX)), normalizedX); }
+        else { y = currentClipper->process(normalizedX); }
         normalizedX = juce::jmap(normalizedX, -1.0f, 1.0f, bounds.getX(), bounds.getRight());
         normalizedY = juce::jmap(y, -1.0f, 1.0f, bounds.getBottom(), bounds.getY());
         if (i == 0) { graph.startNewSubPath(normalizedX, normalizedY); }
@@ -372,6 +516,43 @@ void TransientFunctionGraph::paint(juce::Graphics& g)
     }
     g.setColour(juce::Colours::orange);
     g.strokePath(graph, juce::PathStrokeType(lineThickness, juce::PathStrokeType::curved));
+    if (customCurveShown)
+    {
+        const float pointSize{ 3.0f * lineThickness };
+        g.setColour(juce::Colours::white);
+        for (const auto& point : customCurve.getPoints())
+        {
+            for (bool mirrored : { false, true })
+            {
+                const auto position{ curveToScreen(point, mirrored) };
+                g.fillEllipse(juce::Rectangle<float>(pointSize, pointSize).withCentre(position));
+            }
+        }
+    }
+    if (harmonicReportValid) { drawHarmonics(g, bounds); }
+}
+
+void TransientFunctionGraph::drawHarmonics(juce::Graphics& g, const juce::Rectangle<float>& bounds)
+{
+    // столбики гармоник от -100 до 0 dBc в нижней пятой части графика
+    const float minLevelInDb{ -100.0f };
+    const auto strip{ bounds.withTrimmedTop(bounds.getHeight() * 0.8f) };
+    const auto barWidth{ strip.getWidth() / static_cast<float>(harmonicReport.harmonicsInDb.size()) };
+    g.setColour(juce::Colours::white.withAlpha(0.3f));
+    for (size_t i = 0; i < harmonicReport.harmonicsInDb.size(); ++i)
+    {
+        const auto level{ juce::jlimit(minLevelInDb, 0.0f, static_cast<float>(harmonicReport.harmonicsInDb[i])) };
+        const auto height{ strip.getHeight() * (level - minLevelInDb) / -minLevelInDb };
+        g.fillRect(juce::Rectangle<float>(strip.getX() + barWidth * static_cast<float>(i), strip.getBottom() - height,
+                                          barWidth - 1.0f, height));
+    }
+    g.setColour(juce::Colours::white.withAlpha(0.8f));
+    g.setFont(label.getFont().withHeight(14.0f));
+    auto text{ bounds.reduced(2.0f).removeFromTop(32.0f) };
+    g.drawText("THD " + juce::String(harmonicReport.thd * 100.0, 1) + " %",
+               text.removeFromTop(16.0f), juce::Justification::centredLeft);
+    g.drawText("ALIAS " + juce::String(juce::roundToInt(harmonicReport.aliasInDb)) + " dB",
+               text, juce::Justification::centredLeft);
 }
 
 void TransientFunctionGraph::resized()
@@ -379,7 +560,127 @@ void TransientFunctionGraph::resized()
     auto bounds{ getLocalBounds() };
     label.setBounds(bounds.removeFromTop(LABEL_HEIGHT));
     label.setJustificationType(juce::Justification::centredTop);
-    drawBackground();
+    bkgd = {}; // растр фона строится в таймере, уже после показа окна
+}
+//==============================================================================
+SpectrumDisplay::SpectrumDisplay(SpectrumAnalyzer& a) : analyzer(a)
+{
+    setVisible(false);
+}
+
+SpectrumDisplay::~SpectrumDisplay() { analyzer.setActive(false); }
+
+void SpectrumDisplay::visibilityChanged()
+{
+    // пока спектр не виден, аудиопоток не отдаёт в анализатор ни одного отсчёта
+    analyzer.setActive(isVisible());
+    if (isVisible()) { startTimerHz(SPECTRUM_FPS); }
+    else { stopTimer(); }
+}
+
+juce::Rectangle<float> SpectrumDisplay::getGraphBounds() const
+{
+    return getLocalBounds().toFloat().withTrimmedTop(LABEL_HEIGHT).reduced(cornerSize);
+}
+
+void SpectrumDisplay::timerCallback()
+{
+    if (!bkgd.isValid() && !getLocalBounds().isEmpty()) { drawBackground(); }
+    const auto version{ analyzer.getVersion() };
+    if (version == lastVersion) { return; }
+    lastVersion = version;
+    if (analyzer.getMaxFrequency() != maxFrequency)
+    {
+        maxFrequency = analyzer.getMaxFrequency();
+        drawBackground();
+    }
+    analyzer.getSpectrum(preClipTap, levels, peaks);
+    prePath = createPath(levels, true);
+    analyzer.getSpectrum(postClipTap, levels, peaks);
+    postPath = createPath(levels, false);
+    peakPath = createPath(peaks, false);
+    repaint();
+}
+
+juce::Path SpectrumDisplay::createPath(const SpectrumAnalyzer::Spectrum& spectrum, bool closed) const
+{
+    const auto bounds{ getGraphBounds() };
+    juce::Path path;
+    for (size_t bin = 0; bin < spectrum.size(); ++bin)
+    {
+        // полосы анализатора уже логарифмические, поэтому по оси X они идут равномерно
+        const auto x{ bounds.getX() + bounds.getWidth() * (static_cast<float>(bin) + 0.5f) / static_cast<float>(spectrum.size()) };
+        const auto y{ juce::jmap(juce::jlimit(minLevelInDb, 0.0f, spectrum[bin]), minLevelInDb, 0.0f, bounds.getBottom(), bounds.getY()) };
+        if (bin == 0)
+        {
+            if (closed) { path.startNewSubPath(x, bounds.getBottom()); path.lineTo(x, y); }
+            else { path.startNewSubPath(x, y); }
+        }
+        else { path.lineTo(x, y); }
+    }
+    if (closed && !path.isEmpty())
+    {
+        path.lineTo(path.getCurrentPosition().withY(bounds.getBottom()));
+        path.closeSubPath();
+    }
+    return path;
+}
+
+void SpectrumDisplay::drawBackground()
+{
+    // сетка: декады по частоте и шаг 12 дБ по уровню
+    auto bounds{ getLocalBounds().toFloat().withTrimmedTop(LABEL_HEIGHT) };
+    bkgd = juce::Image(juce::Image::PixelFormat::ARGB,
+                       juce::jmax(1, static_cast<int>(bounds.getWidth())),
+                       juce::jmax(1, static_cast<int>(bounds.getHeight())),
+                       true);
+    juce::Graphics g{ bkgd };
+    drawGrid(g, bounds.withPosition(0.0f, 0.0f));
+}
+
+void SpectrumDisplay::drawGrid(juce::Graphics& g, juce::Rectangle<float> bounds) const
+{
+    bounds.reduce(lineThickness * 0.5f, lineThickness * 0.5f);
+    g.setColour(juce::Colours::black);
+    g.fillRoundedRectangle(bounds, cornerSize);
+    const auto graphBounds{ bounds.reduced(cornerSize) };
+    g.setColour(juce::Colours::darkgrey);
+    for (float frequency : { 100.0f, 1000.0f, 10000.0f })
+    {
+        if (frequency >= maxFrequency) { continue; }
+        const auto proportion{ std::log(frequency / SpectrumAnalyzer::minFrequency) / std::log(maxFrequency / SpectrumAnalyzer::minFrequency) };
+        const auto x{ graphBounds.getX() + graphBounds.getWidth() * proportion };
+        g.drawLine(x, graphBounds.getY(), x, graphBounds.getBottom());
+    }
+    for (float level = -12.0f; level > minLevelInDb; level -= 12.0f)
+    {
+        const auto y{ juce::jmap(level, minLevelInDb, 0.0f, graphBounds.getBottom(), graphBounds.getY()) };
+        g.drawLine(graphBounds.getX(), y, graphBounds.getRight(), y, 0.5f);
+    }
+    g.setColour(juce::Colours::white);
+    g.drawRoundedRectangle(bounds, cornerSize, lineThickness);
+}
+
+void SpectrumDisplay::paint(juce::Graphics& g)
+{
+    TRACE_SCOPE("SpectrumDisplay::paint");
+    if (bkgd.isValid()) { g.drawImageAt(bkgd, 0, LABEL_HEIGHT); }
+    else { drawGrid(g, getLocalBounds().toFloat().withTrimmedTop(LABEL_HEIGHT)); } // окно спектра открыто раньше тика таймера
+    g.setColour(juce::Colours::lightgrey.withAlpha(0.35f));
+    g.fillPath(prePath);
+    g.setColour(juce::Colours::orange);
+    g.strokePath(postPath, juce::PathStrokeType(lineThickness, juce::PathStrokeType::curved));
+    g.setColour(juce::Colours::white.withAlpha(0.5f));
+    g.strokePath(peakPath, juce::PathStrokeType(1.0f));
+}
+
+void SpectrumDisplay::resized()
+{
+    auto bounds{ getLocalBounds() };
+    label.setBounds(bounds.removeFromTop(LABEL_HEIGHT));
+    label.setJustificationType(juce::Justification::centredTop);
+    bkgd = {}; // спектр скрыт при открытии окна, сетка растрируется при первом показе
+    lastVersion = analyzer.getVersion() - 1; // пути пересобираются под новый размер
 }
 //==============================================================================
 PresetPanel::PresetPanel(juce::LookAndFeel& _lnf, PresetManager& pm) : lnf(_lnf), manager(pm)
@@ -391,8 +692,7 @@ PresetPanel::PresetPanel(juce::LookAndFeel& _lnf, PresetManager& pm) : lnf(_lnf)
     addAndMakeVisible(previousButton);
     previousButton.onClick = [&]()
     {
-        const int index{ manager.previousPreset() };
-        presetNameLabel.setText(manager.currentPreset.toString(), juce::NotificationType::dontSendNotification);
+        const int index{ manager.previousPreset() }; // название обновится после загрузки пресета
     };
 
     nextButton.setButtonText(">");
@@ -401,10 +701,9 @@ PresetPanel::PresetPanel(juce::LookAndFeel& _lnf, PresetManager& pm) : lnf(_lnf)
     nextButton.onClick = [&]()
     {
         const int index{ manager.nextPreset() };
-        presetNameLabel.setText(manager.currentPreset.toString(), juce::NotificationType::dontSendNotification);
     };
 
-    updatePresetMenu();
+    // пункты меню заполняет окно после первого кадра, см. DestructionAudioProcessorEditor::finishOpening
     presetMenu.setTextWhenNothingSelected("");
     const auto presetMenuIndex{ manager.presetList.indexOf(manager.currentPreset.toString()) };
     juce::String initialPresetName;
@@ -413,6 +712,7 @@ PresetPanel::PresetPanel(juce::LookAndFeel& _lnf, PresetManager& pm) : lnf(_lnf)
     presetNameLabel.setText(initialPresetName, juce::NotificationType::dontSendNotification);
     presetMenu.setLookAndFeel(&lnf);
     addAndMakeVisible(presetMenu);
+    manager.addChangeListener(this);
     presetMenu.onChange = [this]()
     {
         switch (presetMenu.getSelectedId())
@@ -435,7 +735,6 @@ PresetPanel::PresetPanel(juce::LookAndFeel& _lnf, PresetManager& pm) : lnf(_lnf)
                 {
                     const auto fileToSave{ chooser.getResult() };
                     manager.savePreset(fileToSave.getFileNameWithoutExtension());
-                    updatePresetMenu();
                     presetNameLabel.setText(manager.currentPreset.toString(), juce::NotificationType::dontSendNotification);
                     presetMenu.setSelectedId(0, juce::NotificationType::dontSendNotification);
                 });
@@ -451,12 +750,25 @@ PresetPanel::PresetPanel(juce::LookAndFeel& _lnf, PresetManager& pm) : lnf(_lnf)
                 {
                     const auto fileToLoad{ chooser.getResult() };
                     manager.loadPreset(fileToLoad.getFileNameWithoutExtension());
-                    manager.currentPreset.setValue(manager.currentPreset.toString());
-                    presetNameLabel.setText(manager.currentPreset.toString(), juce::NotificationType::dontSendNotification);
                     presetMenu.setSelectedId(0, juce::NotificationType::dontSendNotification);
                 });
             break;
         }
+        case (PresetMenuIDs::MorphA):
+        case (PresetMenuIDs::MorphB):
+        {
+            // текущий пресет декодируется заранее и становится точкой морфинга
+            manager.setMorphEndpoint(presetMenu.getSelectedId() == PresetMenuIDs::MorphA ? 0 : 1,
+                                     manager.currentPreset.toString());
+            presetMenu.setSelectedId(0, juce::NotificationType::dontSendNotification);
+            break;
+        }
+        case (PresetMenuIDs::ClearMorph):
+        {
+            manager.clearMorph();
+            presetMenu.setSelectedId(0, juce::NotificationType::dontSendNotification);
+            break;
+        }
         case (PresetMenuIDs::Delete):
         {
             if (presetNameLabel.getText() == "-init-")
@@ -491,8 +803,6 @@ PresetPanel::PresetPanel(juce::LookAndFeel& _lnf, PresetManager& pm) : lnf(_lnf)
                     if (result == 1)
                     {
                         manager.deletePreset(presetNameLabel.getText());
-                        updatePresetMenu();
-                        presetNameLabel.setText("-init-", juce::NotificationType::dontSendNotification);
                     }
                     aw->exitModalState(result);
                     aw->setVisible(false);
@@ -503,8 +813,6 @@ PresetPanel::PresetPanel(juce::LookAndFeel& _lnf, PresetManager& pm) : lnf(_lnf)
         {
             auto presetName{ presetMenu.getItemText(presetMenu.getSelectedItemIndex()) };
             manager.loadPreset(presetName);
-            manager.currentPreset.setValue(presetName);
-            presetNameLabel.setText(presetName, juce::NotificationType::dontSendNotification);
             presetMenu.setSelectedId(0, juce::NotificationType::dontSendNotification);
             break;
         }
@@ -512,6 +820,8 @@ PresetPanel::PresetPanel(juce::LookAndFeel& _lnf, PresetManager& pm) : lnf(_lnf)
     };
 }
 
+PresetPanel::~PresetPanel() { manager.removeChangeListener(this); }
+
 juce::Label* PresetPanel::getPresetNameLabel() { return &presetNameLabel; }
 
 void PresetPanel::updatePresetMenu()
@@ -522,9 +832,20 @@ void PresetPanel::updatePresetMenu()
     presetMenu.addItem("Load preset...", PresetMenuIDs::Load);
     presetMenu.addItem("Delete preset", PresetMenuIDs::Delete);
     presetMenu.addSeparator();
+    presetMenu.addItem("Set as morph A", PresetMenuIDs::MorphA);
+    presetMenu.addItem("Set as morph B", PresetMenuIDs::MorphB);
+    presetMenu.addItem("Clear morph", PresetMenuIDs::ClearMorph);
+    presetMenu.addSeparator();
     presetMenu.addItemList(manager.presetList, PresetMenuIDs::PresetList);
 }
 
+void PresetPanel::changeListenerCallback(juce::ChangeBroadcaster*)
+{
+    // вызывается после асинхронной загрузки, сохранения или удаления пресета
+    updatePresetMenu();
+    presetNameLabel.setText(manager.currentPreset.toString(), juce::NotificationType::dontSendNotification);
+}
+
 void PresetPanel::resized()
 {
     auto bounds{ getLocalBounds() };
@@ -537,6 +858,196 @@ void PresetPanel::resized()
     presetNameLabel.setBounds(presetMenu.getBounds());
 }
 //==============================================================================
+MorphPanel::MorphPanel(juce::LookAndFeel& lnf, PresetManager& pm, juce::Font& font) : manager(pm)
+{
+    slider.setRange(0.0, 1.0);
+    slider.setLookAndFeel(&lnf);
+    slider.setColour(juce::Slider::ColourIds::trackColourId, juce::Colours::orange);
+    slider.setColour(juce::Slider::ColourIds::thumbColourId, juce::Colours::white);
+    slider.setColour(juce::Slider::ColourIds::backgroundColourId, juce::Colours::black.contrasting(0.3f));
+    for (auto* label : { &presetALabel, &presetBLabel })
+    {
+        label->setFont(font);
+        addAndMakeVisible(label);
+    }
+    presetALabel.setJustificationType(juce::Justification::centredLeft);
+    presetBLabel.setJustificationType(juce::Justification::centredRight);
+    addAndMakeVisible(slider);
+    manager.addChangeListener(this);
+    changeListenerCallback(nullptr);
+}
+
+MorphPanel::~MorphPanel() { manager.removeChangeListener(this); }
+
+void MorphPanel::changeListenerCallback(juce::ChangeBroadcaster*)
+{
+    auto nameOrDash = [](const juce::String& name) { return name.isEmpty() ? juce::String("-") : name; };
+    presetALabel.setText("A: " + nameOrDash(manager.getMorphEndpointName(0)), juce::NotificationType::dontSendNotification);
+    presetBLabel.setText("B: " + nameOrDash(manager.getMorphEndpointName(1)), juce::NotificationType::dontSendNotification);
+    slider.setEnabled(manager.getMorphEndpointName(0).isNotEmpty() && manager.getMorphEndpointName(1).isNotEmpty());
+}
+
+void MorphPanel::resized()
+{
+    auto bounds{ getLocalBounds() };
+    const int labelWidth{ bounds.proportionOfWidth(0.25) };
+    presetALabel.setBounds(bounds.removeFromLeft(labelWidth));
+    presetBLabel.setBounds(bounds.removeFromRight(labelWidth));
+    slider.setBounds(bounds);
+}
+//==============================================================================
+StagesPanel::StagesPanel(juce::LookAndFeel& lnf, APVTS& apvts, juce::Font& font)
+{
+    auto setupSlider = [this, &lnf](juce::Slider& slider)
+    {
+        slider.setLookAndFeel(&lnf);
+        slider.setTextBoxStyle(juce::Slider::TextEntryBoxPosition::TextBoxRight, false, 45, 20);
+        slider.setColour(juce::Slider::ColourIds::trackColourId, juce::Colours::orange);
+        slider.setColour(juce::Slider::ColourIds::thumbColourId, juce::Colours::white);
+        slider.setColour(juce::Slider::ColourIds::backgroundColourId, juce::Colours::black.contrasting(0.3f));
+        addAndMakeVisible(slider);
+    };
+    label.setFont(font);
+    addAndMakeVisible(label);
+    stagesLabel.setFont(font.withHeight(FONT_HEIGHT - 4.0f));
+    addAndMakeVisible(stagesLabel);
+    setupSlider(stagesSlider);
+    stagesSlider.onValueChange = [this]() { updateRows(); };
+    stagesAttach = std::make_unique<APVTS::SliderAttachment>(apvts, "Stages", stagesSlider);
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+        auto& row{ rows[i] };
+        const auto prefix{ "Stage " + juce::String(static_cast<int>(i) + 2) + " " };
+        row.name.setText(juce::String(static_cast<int>(i) + 2), juce::NotificationType::dontSendNotification);
+        row.name.setFont(font.withHeight(FONT_HEIGHT - 4.0f));
+        row.name.setJustificationType(juce::Justification::centred);
+        addAndMakeVisible(row.name);
+        // названия типов берутся из параметра, чтобы порядок пунктов совпадал с индексами выбора
+        if (auto* typeParameter = dynamic_cast<juce::AudioParameterChoice*>(apvts.getParameter(prefix + "Type")))
+        {
+            row.typeBox.addItemList(typeParameter->choices, 1);
+        }
+        row.typeBox.setLookAndFeel(&lnf);
+        addAndMakeVisible(row.typeBox);
+        setupSlider(row.clipSlider);
+        setupSlider(row.gainSlider);
+        row.gainSlider.setTextValueSuffix(" dB");
+        row.typeAttach = std::make_unique<APVTS::ComboBoxAttachment>(apvts, prefix + "Type", row.typeBox);
+        row.clipAttach = std::make_unique<APVTS::SliderAttachment>(apvts, prefix + "Clip", row.clipSlider);
+        row.gainAttach = std::make_unique<APVTS::SliderAttachment>(apvts, prefix + "Gain", row.gainSlider);
+    }
+    updateRows();
+    setVisible(false);
+}
+
+void StagesPanel::updateRows()
+{
+    const auto numStages{ static_cast<int>(stagesSlider.getValue()) };
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+        const bool enabled{ static_cast<int>(i) + 2 <= numStages };
+        for (juce::Component* component : { static_cast<juce::Component*>(&rows[i].name), static_cast<juce::Component*>(&rows[i].typeBox),
+                                            static_cast<juce::Component*>(&rows[i].clipSlider), static_cast<juce::Component*>(&rows[i].gainSlider) })
+        {
+            component->setEnabled(enabled);
+            component->setAlpha(enabled ? 1.0f : 0.4f);
+        }
+    }
+}
+
+void StagesPanel::paint(juce::Graphics& g)
+{
+    auto bounds{ getLocalBounds().toFloat().withTrimmedTop(LABEL_HEIGHT) };
+    bounds.reduce(lineThickness * 0.5f, lineThickness * 0.5f);
+    g.setColour(juce::Colours::black);
+    g.fillRoundedRectangle(bounds, cornerSize);
+}
+
+void StagesPanel::resized()
+{
+    auto bounds{ getLocalBounds() };
+    label.setBounds(bounds.removeFromTop(LABEL_HEIGHT));
+    label.setJustificationType(juce::Justification::centredTop);
+    bounds.reduce(static_cast<int>(cornerSize), static_cast<int>(cornerSize));
+    const int rowHeight{ bounds.getHeight() / static_cast<int>(rows.size() + 1) };
+    auto stagesBounds{ bounds.removeFromTop(rowHeight) };
+    stagesLabel.setBounds(stagesBounds.removeFromLeft(stagesBounds.proportionOfWidth(0.25)));
+    stagesSlider.setBounds(stagesBounds);
+    for (auto& row : rows)
+    {
+        auto rowBounds{ bounds.removeFromTop(rowHeight) };
+        const int width{ rowBounds.getWidth() };
+        row.name.setBounds(rowBounds.removeFromLeft(20));
+        row.typeBox.setBounds(rowBounds.removeFromLeft((width - 20) / 3).reduced(1));
+        row.clipSlider.setBounds(rowBounds.removeFromLeft(rowBounds.getWidth() / 2));
+        row.gainSlider.setBounds(rowBounds);
+    }
+}
+//==============================================================================
+LoadMeterPanel::LoadMeterPanel(DestructionAudioProcessor& p, const EditorOpenTiming& _openTiming, juce::Font& _font)
+    : audioProcessor(p), openTiming(_openTiming), font(_font)
+{
+    setVisible(false);
+}
+
+void LoadMeterPanel::visibilityChanged()
+{
+    if (isVisible()) { startTimerHz(10); }
+    else { stopTimer(); }
+}
+
+void LoadMeterPanel::timerCallback()
+{
+    statistics = audioProcessor.getLoadStatistics();
+    repaint();
+}
+
+void LoadMeterPanel::mouseDoubleClick(const juce::MouseEvent&) { audioProcessor.resetLoadStatistics(); }
+
+void LoadMeterPanel::paint(juce::Graphics& g)
+{
+    auto bounds{ getLocalBounds().toFloat() };
+    g.setColour(juce::Colours::black.withAlpha(0.85f));
+    g.fillRoundedRectangle(bounds, 6.0f);
+    g.setColour(juce::Colours::orange);
+    g.drawRoundedRectangle(bounds.reduced(0.5f), 6.0f, 1.0f);
+    bounds.reduce(10.0f, 6.0f);
+    auto percent = [](double value) { return juce::String(value * 100.0, 1) + "%"; };
+    const float rowHeight{ 18.0f };
+    g.setFont(font.withHeight(16.0f));
+    g.setColour(juce::Colours::white);
+    auto titleRow{ bounds.removeFromTop(rowHeight) };
+    g.drawText("CPU LOAD  /  BUDGET " + juce::String(statistics.budgetMs, 2) + " MS",
+               titleRow, juce::Justification::centredLeft);
+    // время до первого кадра окна, оранжевым - если бюджет открытия превышен
+    g.setColour(openTiming.firstFrameMs > EDITOR_OPEN_BUDGET_MS ? juce::Colours::orange : juce::Colours::grey);
+    g.drawText("UI " + juce::String(openTiming.firstFrameMs, 1) + " MS", titleRow, juce::Justification::centredRight);
+    g.setColour(juce::Colours::white);
+    g.drawText("AVG " + percent(statistics.average) + "   P99 " + percent(statistics.p99)
+               + "   MAX " + percent(statistics.worst),
+               bounds.removeFromTop(rowHeight), juce::Justification::centredLeft);
+    // средняя доля каждого этапа processBlock
+    const juce::StringArray stageNames{ "IN", "CLIP", "OUT", "LIM", "TAPS" };
+    for (int i = 0; i < numLoadStages; ++i)
+    {
+        auto row{ bounds.removeFromTop(rowHeight) };
+        const auto share{ statistics.stageAverage[static_cast<size_t>(i)] };
+        g.setColour(juce::Colours::white);
+        g.drawText(stageNames[i], row.removeFromLeft(50.0f), juce::Justification::centredLeft);
+        g.drawText(percent(share), row.removeFromRight(60.0f), juce::Justification::centredRight);
+        g.setColour(juce::Colours::darkgrey);
+        g.fillRect(row.reduced(0.0f, 6.0f));
+        g.setColour(juce::Colours::orange);
+        g.fillRect(row.reduced(0.0f, 6.0f).withWidth(row.getWidth() * static_cast<float>(juce::jlimit(0.0, 1.0, share))));
+    }
+    if (statistics.qualityLevel > 0)
+    {
+        g.setColour(juce::Colours::orange);
+        g.drawText("GOVERNOR: QUALITY -" + juce::String(statistics.qualityLevel),
+                   bounds.removeFromTop(rowHeight), juce::Justification::centredLeft);
+    }
+}
+//==============================================================================
 void Plate::paint(juce::Graphics& g)
 {
     auto bounds{ getLocalBounds().toFloat() };
@@ -553,11 +1064,17 @@ void Plate::paint(juce::Graphics& g)
 }
 //==============================================================================
 DestructionAudioProcessorEditor::DestructionAudioProcessorEditor (DestructionAudioProcessor& p)
-    : AudioProcessorEditor (&p), audioProcessor (p), presetPanel(newLNF, audioProcessor.getPresetManager())
+    : AudioProcessorEditor (&p), audioProcessor (p), spectrumDisplay(p.getSpectrumAnalyzer()),
+      presetPanel(newLNF, audioProcessor.getPresetManager())
 {
-    setSize (660, 210);
-    juce::Font font{ juce::Typeface::createSystemTypefaceFor(BinaryData::MagistralTT_ttf, BinaryData::MagistralTT_ttfSize) };
+    juce::Font font{ resources->getTypeface() };
     font.setHeight(18.0f);
+    // панели создаются до setSize, так как resized() задаёт их границы
+    morphPanel = std::make_unique<MorphPanel>(newLNF, audioProcessor.getPresetManager(), font);
+    loadMeterPanel = std::make_unique<LoadMeterPanel>(audioProcessor, openTiming, font);
+    stagesPanel = std::make_unique<StagesPanel>(newLNF, audioProcessor.apvts, font);
+    setSize (660, 240);
+    addAndMakeVisible(*morphPanel);
     addAndMakeVisible(presetPanel);
     addAndMakeVisible(sliderPlate);
     addAndMakeVisible(graphPlate);
@@ -574,12 +1091,13 @@ DestructionAudioProcessorEditor::DestructionAudioProcessorEditor (DestructionAud
     clipperBox.addItem("Fold Back", foldback);
     clipperBox.addItem("Sine Fold", sinefold);
     clipperBox.addItem("Linear Fold", linearfold);
+    clipperBox.addItem("Custom", custom);
     clipperBox.setSelectedItemIndex(1);
     clipperBox.onChange = [this]()
     {
-        audioProcessor.clipHolder.setClipper(clipperBox.getSelectedItemIndex());
-        audioProcessor.clipHolder.getClipper()->updateMultiplier(clipSlider.slider.getValue());
-        graph.initialize(audioProcessor.clipHolder.getClipper());
+        audioProcessor.updatePluginState();
+        graph.initialize(audioProcessor.clipHolder.getClipper(clipperBox.getSelectedItemIndex()));
+        graph.setHarmonicKey(clipperBox.getSelectedItemIndex(), clipSlider.slider.getValue());
         graph.update();
     };
     clipperBox.setLookAndFeel(&newLNF);
@@ -595,13 +1113,14 @@ DestructionAudioProcessorEditor::DestructionAudioProcessorEditor (DestructionAud
     inputGainSlider.initialize(rotaryParameters, -12.0, 12.0, 0.0, "dB", "IN", &newLNF, font);
     outputGainSlider.initialize(rotaryParameters, -12.0, 12.0, 0.0, "dB", "OUT", &newLNF, font);
     clipSlider.initialize(rotaryParameters, 1.0, 10.0, 1.0, "", "CLIP", &newLNF, font);
+    mixSlider.initialize(rotaryParameters, 0.0, 1.0, 1.0, "%", "MIX", &newLNF, font);
     inputGainSlider.slider.onValueChange = [this]()
     {
         double newValue{ inputGainSlider.slider.getValue() };
         inputGainSlider.valueText.setText(juce::String(newValue, 1) + " dB",
                                           juce::NotificationType::dontSendNotification);
-        audioProcessor.gainController.setInputGainLevelInDb(newValue);
-        if (linkButton.getToggleState())
+        audioProcessor.updatePluginState();
+        if (linkButton.getToggleState() && !autoGainButton.getToggleState())
         {
             outputGainSlider.slider.setValue(-newValue);
         }
@@ -611,8 +1130,8 @@ DestructionAudioProcessorEditor::DestructionAudioProcessorEditor (DestructionAud
         double newValue{ outputGainSlider.slider.getValue() };
         outputGainSlider.valueText.setText(juce::String(newValue, 1) + " dB",
                                            juce::NotificationType::dontSendNotification);
-        audioProcessor.gainController.setOutputGainLevelInDb(newValue);
-        if (linkButton.getToggleState())
+        audioProcessor.updatePluginState();
+        if (linkButton.getToggleState() && !autoGainButton.getToggleState())
         {
             inputGainSlider.slider.setValue(-newValue);
         }
@@ -621,18 +1140,26 @@ DestructionAudioProcessorEditor::DestructionAudioProcessorEditor (DestructionAud
     {
         double newValue{ clipSlider.slider.getValue() };
         clipSlider.valueText.setText(juce::String(newValue, 1), juce::NotificationType::dontSendNotification);
-        audioProcessor.clipHolder.getClipper()->updateMultiplier(newValue);
+        audioProcessor.updatePluginState();
+        graph.setHarmonicKey(clipperBox.getSelectedItemIndex(), newValue);
         graph.update();
     };
     addAndMakeVisible(inputGainSlider);
     addAndMakeVisible(outputGainSlider);
+    mixSlider.slider.onValueChange = [this]()
+    {
+        mixSlider.valueText.setText(juce::String(juce::roundToInt(mixSlider.slider.getValue() * 100.0)) + " %",
+                                    juce::NotificationType::dontSendNotification);
+    };
+    mixSlider.slider.onValueChange();
     addAndMakeVisible(clipSlider);
+    addAndMakeVisible(mixSlider);
     //==================================================
     // linkButton settings
     linkButton.setToggleState(true, juce::NotificationType::sendNotification);
     linkButton.onStateChange = [this]()
     {
-        if (linkButton.getToggleState())
+        if (linkButton.getToggleState() && !autoGainButton.getToggleState())
         {
             if (inputGainSlider.slider.getValue() < 0)
             {
@@ -644,29 +1171,55 @@ DestructionAudioProcessorEditor::DestructionAudioProcessorEditor (DestructionAud
     linkButton.setLookAndFeel(&newLNF);
     addAndMakeVisible(linkButton);
     //==================================================
+    // autoGainButton settings
+    // при автокомпенсации громкости Link не действует, Output Gain остаётся подстройкой
+    autoGainButton.onStateChange = [this]() { linkButton.setEnabled(!autoGainButton.getToggleState()); };
+    autoGainButton.setLookAndFeel(&newLNF);
+    addAndMakeVisible(autoGainButton);
+    //==================================================
     // bypasskButton settings
     bypassButton.setToggleState(false, juce::NotificationType::sendNotification);
-    bypassButton.onStateChange = [this]() { audioProcessor.gainController.setBypassState(bypassButton.getToggleState()); };
+    bypassButton.onStateChange = [this]() { audioProcessor.updatePluginState(); };
     bypassButton.setLookAndFeel(&newLNF);
     addAndMakeVisible(bypassButton);
     //==================================================
     // graph settings
-    graph.startTimerHz(60);
+    // таймер графика (растр фона и запросы гармоник) запускается после первого кадра
     graph.initialize(audioProcessor.clipHolder.getClipper());
+    graph.attachCustomCurve(audioProcessor);
     graph.label.setFont(font);
     graph.addAndMakeVisible(graph.label);
     addAndMakeVisible(graph);
     //==================================================
+    // spectrum settings
+    // щелчок по заголовку графика переключает передаточную функцию и спектр
+    spectrumDisplay.label.setFont(font);
+    spectrumDisplay.addAndMakeVisible(spectrumDisplay.label);
+    addChildComponent(spectrumDisplay);
+    //==================================================
+    // stages settings
+    // каскад - третий вид той же платы: передаточная функция, спектр, ступени
+    addChildComponent(*stagesPanel);
+    for (auto* label : { &graph.label, &spectrumDisplay.label, &stagesPanel->label })
+    {
+        label->setMouseCursor(juce::MouseCursor::PointingHandCursor);
+        label->addMouseListener(this, false);
+    }
+    //==================================================
     // attachment settings
     inputGainAttach = std::make_unique<APVTS::SliderAttachment>(audioProcessor.apvts, "Input Gain", inputGainSlider.slider);
     outputGainAttach = std::make_unique<APVTS::SliderAttachment>(audioProcessor.apvts, "Output Gain", outputGainSlider.slider);
     clipAttach = std::make_unique<APVTS::SliderAttachment>(audioProcessor.apvts, "Clip", clipSlider.slider);
+    mixAttach = std::make_unique<APVTS::SliderAttachment>(audioProcessor.apvts, "Mix", mixSlider.slider);
     bypassAttach = std::make_unique<APVTS::ButtonAttachment>(audioProcessor.apvts, "Bypass", bypassButton);
     linkAttach = std::make_unique<APVTS::ButtonAttachment>(audioProcessor.apvts, "Link", linkButton);
+    autoGainAttach = std::make_unique<APVTS::ButtonAttachment>(audioProcessor.apvts, "Auto Gain", autoGainButton);
     clipperBoxAttach = std::make_unique<APVTS::ComboBoxAttachment>(audioProcessor.apvts, "Clipper Type", clipperBox);
+    morphAttach = std::make_unique<APVTS::SliderAttachment>(audioProcessor.apvts, "Morph", morphPanel->slider);
+    graph.setHarmonicKey(clipperBox.getSelectedItemIndex(), clipSlider.slider.getValue());
     //==================================================
     // header settings
-    logo = juce::ImageCache::getFromMemory(BinaryData::Logo_transparent_png, BinaryData::Logo_transparent_pngSize);
+    logo = resources->getLogo();
     font.setHeight(26.0f);
     pluginName.setFont(font.withStyle(juce::Font::FontStyleFlags::italic));
     pluginName.setText(juce::String(ProjectInfo::projectName).toUpperCase(), juce::NotificationType::dontSendNotification);
@@ -674,15 +1227,22 @@ DestructionAudioProcessorEditor::DestructionAudioProcessorEditor (DestructionAud
     version.setFont(font.withHeight(FONT_HEIGHT).withStyle(juce::Font::FontStyleFlags::plain));
     version.setText(juce::String("v.") + juce::String(ProjectInfo::versionString), juce::NotificationType::dontSendNotification);
     version.setJustificationType(juce::Justification::centred);
+    version.setInterceptsMouseClicks(false, false); // двойной щелчок открывает панель загрузки
+    addChildComponent(*loadMeterPanel);
+    openTiming.constructionMs = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - openTicks) * 1000.0;
 }
 
 DestructionAudioProcessorEditor::~DestructionAudioProcessorEditor()
 {
+    graph.label.removeMouseListener(this);
+    spectrumDisplay.label.removeMouseListener(this);
+    stagesPanel->label.removeMouseListener(this);
 }
 
 //==============================================================================
 void DestructionAudioProcessorEditor::paint (juce::Graphics& g)
 {
+    TRACE_SCOPE("DestructionAudioProcessorEditor::paint");
     /* Для отрисовки фона заголовка и тела окна плагина использован
     класс std::map<key, T>. Это карта, содержащая значения и их ключи.
     Заполнение карты производится с помощью функции emplace(),
@@ -707,14 +1267,52 @@ void DestructionAudioProcessorEditor::paint (juce::Graphics& g)
 
     juce::Rectangle<float> logoBounds{ 0.0f, 0.0f, 50.0f, 40.0f };
     g.drawImage(logo, logoBounds, juce::RectanglePlacement::centred, false);
+    if (shadowCache.isValid()) { g.drawImageAt(shadowCache, 0, 0); }
+}
+
+void DestructionAudioProcessorEditor::paintOverChildren(juce::Graphics&)
+{
+    if (openingScheduled) { return; }
+    // первый кадр со всеми дочерними компонентами готов, остальное доделывается следующим сообщением
+    openingScheduled = true;
+    openTiming.firstFrameMs = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - openTicks) * 1000.0;
+    juce::MessageManager::callAsync([safeThis = juce::Component::SafePointer<DestructionAudioProcessorEditor>(this)]()
+        {
+            if (safeThis != nullptr) { safeThis->finishOpening(); }
+        });
+}
+
+void DestructionAudioProcessorEditor::finishOpening()
+{
+    /* Работа, не нужная для первого кадра: пункты меню пресетов,
+    размытие теней, растр фона графика и фоновый анализ гармоник,
+    который запрашивает таймер графика. */
+    TRACE_SCOPE("DestructionAudioProcessorEditor::finishOpening");
+    const auto startTicks{ juce::Time::getHighResolutionTicks() };
+    presetPanel.updatePresetMenu();
+    drawShadowCache();
+    graph.startTimerHz(60);
+    opened = true;
+    openTiming.deferredMs = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks) * 1000.0;
+    repaint();
+}
 
-    sliderPlateShadow = std::make_unique<juce::DropShadow>(juce::Colours::orange, 8, juce::Point<int>(5, 5));
-    graphPlateShadow  = std::make_unique<juce::DropShadow>(juce::Colours::orange, 8, juce::Point<int>(5, 5));
+void DestructionAudioProcessorEditor::drawShadowCache()
+{
+    shadowCache = juce::Image(juce::Image::PixelFormat::ARGB, juce::jmax(1, getWidth()), juce::jmax(1, getHeight()), true);
+    juce::Graphics g{ shadowCache };
+    if (sliderPlateShadow == nullptr)
+    {
+        sliderPlateShadow = std::make_unique<juce::DropShadow>(juce::Colours::orange, 8, juce::Point<int>(5, 5));
+        graphPlateShadow  = std::make_unique<juce::DropShadow>(juce::Colours::orange, 8, juce::Point<int>(5, 5));
+    }
     juce::Path path;
     drawShadows(g, path, sliderPlate.getBounds().reduced(3), sliderPlateShadow);
     drawShadows(g, path, graphPlate.getBounds().reduced(3), graphPlateShadow);
 }
 
+const EditorOpenTiming& DestructionAudioProcessorEditor::getOpenTiming() const noexcept { return openTiming; }
+
 void DestructionAudioProcessorEditor::resized()
 {
     int spacing{ 5 };
@@ -722,24 +1320,57 @@ void DestructionAudioProcessorEditor::resized()
     int plateReduction{ 10 };
     auto bounds{ getLocalBounds() };
     auto headerBounds{ bounds.removeFromTop(40) }; // под лого и название
+    morphPanel->setBounds(bounds.removeFromBottom(30).reduced(plateReduction, 0));
     auto plateBounds{ bounds };    
     sliderPlate.setBounds(plateBounds.removeFromRight(bounds.proportionOfWidth(0.5)).reduced(plateReduction));
     graphPlate.setBounds(plateBounds.reduced(plateReduction));
     // заполняем sliderPlate
     auto staticBounds = plateBounds = sliderPlate.getBounds().reduced(spacing);
-    outputGainSlider.setBounds(plateBounds.removeFromRight(staticBounds.proportionOfWidth(0.33)).reduced(spacing));
-    clipSlider.setBounds(plateBounds.removeFromRight(staticBounds.proportionOfWidth(0.33)).reduced(spacing));
+    outputGainSlider.setBounds(plateBounds.removeFromRight(staticBounds.proportionOfWidth(0.25)).reduced(spacing));
+    mixSlider.setBounds(plateBounds.removeFromRight(staticBounds.proportionOfWidth(0.25)).reduced(spacing));
+    clipSlider.setBounds(plateBounds.removeFromRight(staticBounds.proportionOfWidth(0.25)).reduced(spacing));
     inputGainSlider.setBounds(plateBounds.reduced(spacing));
     // заполняем graphPlate
     staticBounds = plateBounds = graphPlate.getBounds().reduced(spacing);
     graph.setBounds(plateBounds.removeFromTop(plateBounds.getHeight() - buttonHeight - 2 * spacing).reduced(spacing));
-    linkButton.setBounds(plateBounds.removeFromRight(staticBounds.proportionOfWidth(0.3)).reduced(spacing));
-    bypassButton.setBounds(plateBounds.removeFromRight(staticBounds.proportionOfWidth(0.3)).reduced(spacing));
+    spectrumDisplay.setBounds(graph.getBounds());
+    stagesPanel->setBounds(graph.getBounds());
+    linkButton.setBounds(plateBounds.removeFromRight(staticBounds.proportionOfWidth(0.2)).reduced(spacing));
+    autoGainButton.setBounds(plateBounds.removeFromRight(staticBounds.proportionOfWidth(0.2)).reduced(spacing));
+    bypassButton.setBounds(plateBounds.removeFromRight(staticBounds.proportionOfWidth(0.22)).reduced(spacing));
     clipperBox.setBounds(plateBounds.reduced(spacing));
     presetPanel.setBounds(headerBounds.removeFromRight(headerBounds.proportionOfWidth(0.5)).reduced(9));
     headerBounds.removeFromLeft(50 + 10); // под лого
     pluginName.setBounds(headerBounds.removeFromLeft(200));
     version.setBounds(headerBounds);
+    loadMeterPanel->setBounds(graphPlate.getBounds());
+    // до первого кадра тени не рисуются, после него перерисовываются под новые границы плат
+    if (opened) { drawShadowCache(); }
+    else { shadowCache = {}; }
+}
+
+void DestructionAudioProcessorEditor::mouseUp(const juce::MouseEvent& event)
+{
+    if (event.eventComponent == &graph.label || event.eventComponent == &spectrumDisplay.label
+        || event.eventComponent == &stagesPanel->label)
+    {
+        // по кругу: передаточная функция -> спектр -> ступени
+        const bool showSpectrum{ graph.isVisible() };
+        const bool showStages{ spectrumDisplay.isVisible() };
+        spectrumDisplay.setVisible(showSpectrum);
+        stagesPanel->setVisible(showStages);
+        graph.setVisible(!showSpectrum && !showStages);
+    }
+}
+
+void DestructionAudioProcessorEditor::mouseDoubleClick(const juce::MouseEvent& event)
+{
+    // события от заголовков графиков приходят сюда же, но в их координатах
+    if (event.eventComponent == this && version.getBounds().contains(event.getPosition()))
+    {
+        loadMeterPanel->setVisible(!loadMeterPanel->isVisible());
+        loadMeterPanel->toFront(false);
+    }
 }
 
 void DestructionAudioProcessorEditor::drawBackground(juce::Graphics& g,
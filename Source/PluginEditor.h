@@ -13,10 +13,21 @@
 
 #define FONT_HEIGHT 18.0f
 #define LABEL_HEIGHT 25
+#define SPECTRUM_FPS 30 // потолок частоты перерисовки спектра
+#define EDITOR_OPEN_BUDGET_MS 30.0 // допустимое время от конструктора окна до первого кадра
 //==============================================================================
-enum PresetMenuIDs { NoSelect, New, Save, Load, Delete, PresetList };
+enum PresetMenuIDs { NoSelect, New, Save, Load, Delete, MorphA, MorphB, ClearMorph, PresetList };
 enum FrameOrientation { None, Left, Right };
 //==============================================================================
+struct EditorOpenTiming
+    /* Время открытия окна в миллисекундах. Первый кадр отсчитывается
+    от начала конструктора, отложенная работа - отдельно. */
+{
+    double constructionMs{ 0.0 };
+    double firstFrameMs{ 0.0 };
+    double deferredMs{ 0.0 };
+};
+//==============================================================================
 class XcytheLookAndFeel_v1 : public juce::LookAndFeel_V4
 {
 public:
@@ -53,6 +64,7 @@ public:
     juce::Array<int> getWidthsForTextButtons(juce::AlertWindow&, const juce::Array<juce::TextButton*>&) override;
     juce::Path createFrame(const juce::Rectangle<float>& bounds, FrameOrientation orientation);
 private:
+    juce::SharedResourcePointer<SharedResources> resources;
     juce::Font font;
 };
 //==============================================================================
@@ -68,32 +80,100 @@ public:
                          juce::Slider::TextEntryBoxPosition::NoTextBox };
 };
 //==============================================================================
-class TransientFunctionGraph : public juce::Component, public juce::Timer
+class TransientFunctionGraph : public juce::Component, public juce::Timer, private juce::ValueTree::Listener
+    /* Когда выбран клиппер Custom, график показывает пользовательскую
+    кривую с опорными точками: точки перетаскиваются мышью, двойной щелчок
+    по пустому месту добавляет точку, по существующей - удаляет её.
+    В углу выводятся THD и алиасинг текущей настройки, внизу - гармоники
+    со 2-й по 20-ю; их считает фоновый анализ процессора. */
 {
 public:
+    ~TransientFunctionGraph() override;
     void initialize(Clipper<float>* clipper);
+    void attachCustomCurve(DestructionAudioProcessor& processor);
     void drawBackground();
     void paint(juce::Graphics& g) override;
     void resized() override;
     void timerCallback() override;
+    void mouseDown(const juce::MouseEvent& event) override;
+    void mouseDrag(const juce::MouseEvent& event) override;
+    void mouseUp(const juce::MouseEvent& event) override;
+    void mouseDoubleClick(const juce::MouseEvent& event) override;
     void update();
+    void setHarmonicKey(int clipperType, double clip);
     juce::Label label{ "name", "TRANSFER FUNCTION" };
 private:
+    void drawFrame(juce::Graphics& g, juce::Rectangle<float> bounds) const;
+    void drawHarmonics(juce::Graphics& g, const juce::Rectangle<float>& bounds);
+    bool isEditingCustomCurve() const;
+    juce::Rectangle<float> getGraphBounds() const;
+    juce::Point<float> curveToScreen(juce::Point<float> point, bool mirrored) const;
+    juce::Point<float> screenToCurve(juce::Point<float> position) const;
+    int findPointAt(juce::Point<float> position) const;
+    void valueTreeRedirected(juce::ValueTree& changedTree) override;
+
+    DestructionAudioProcessor* audioProcessor{ nullptr };
+    TransferCurve customCurve;
+    int draggedPoint{ -1 };
     Clipper<float>* currentClipper{ nullptr };
     juce::uint64 time{ 0 };
     juce::Image bkgd;
     bool needUpdate{ false };
     float lineThickness{ 2.0f };
     float cornerSize{ 4.0f };
+
+    int harmonicClipperType{ 0 };
+    double harmonicClip{ 1.0 };
+    HarmonicReport harmonicReport;
+    bool harmonicReportValid{ false };
+    bool needHarmonicReport{ true };
+    juce::uint32 harmonicGeneration{ 0 };
+};
+//==============================================================================
+class SpectrumDisplay : public juce::Component, public juce::Timer
+    /* Спектр до (серый) и после (оранжевый) клиппинга на одном графике,
+    поверх - удержанные пики после клиппинга. Пути пересобираются в таймере
+    только при новой порции данных анализатора, paint рисует готовое.
+    Сменяет график передаточной функции по щелчку на заголовке. */
+{
+public:
+    explicit SpectrumDisplay(SpectrumAnalyzer& analyzer);
+    ~SpectrumDisplay() override;
+    void paint(juce::Graphics& g) override;
+    void resized() override;
+    void timerCallback() override;
+    void visibilityChanged() override;
+    juce::Label label{ "name", "SPECTRUM" };
+private:
+    void drawBackground();
+    void drawGrid(juce::Graphics& g, juce::Rectangle<float> bounds) const;
+    juce::Rectangle<float> getGraphBounds() const;
+    juce::Path createPath(const SpectrumAnalyzer::Spectrum& spectrum, bool closed) const;
+
+    SpectrumAnalyzer& analyzer;
+    SpectrumAnalyzer::Spectrum levels{};
+    SpectrumAnalyzer::Spectrum peaks{};
+    juce::Path prePath;
+    juce::Path postPath;
+    juce::Path peakPath;
+    juce::uint32 lastVersion{ 0 };
+    juce::Image bkgd;
+    float maxFrequency{ 20000.0f };
+    float lineThickness{ 2.0f };
+    float cornerSize{ 4.0f };
+
+    static constexpr float minLevelInDb{ -90.0f };
 };
 //==============================================================================
-class PresetPanel : public juce::Component
+class PresetPanel : public juce::Component, public juce::ChangeListener
 {
 public:
     PresetPanel(juce::LookAndFeel& _lnf, PresetManager& manager);
+    ~PresetPanel() override;
     juce::Label* getPresetNameLabel();
     void updatePresetMenu();
     void resized() override;
+    void changeListenerCallback(juce::ChangeBroadcaster* source) override;
 private:
     juce::Label presetNameLabel{ "Preset Name", "-init-"};
     juce::LookAndFeel& lnf;
@@ -105,6 +185,71 @@ private:
     std::unique_ptr<juce::AlertWindow> aw;
 };
 //==============================================================================
+class MorphPanel : public juce::Component, public juce::ChangeListener
+{
+public:
+    MorphPanel(juce::LookAndFeel& lnf, PresetManager& manager, juce::Font& font);
+    ~MorphPanel() override;
+    void resized() override;
+    void changeListenerCallback(juce::ChangeBroadcaster* source) override;
+    juce::Slider slider{ juce::Slider::SliderStyle::LinearHorizontal,
+                         juce::Slider::TextEntryBoxPosition::NoTextBox };
+private:
+    PresetManager& manager;
+    juce::Label presetALabel{ "Morph A", "A: -" };
+    juce::Label presetBLabel{ "Morph B", "B: -" };
+};
+//==============================================================================
+class StagesPanel : public juce::Component
+    /* Каскад клипперов: число ступеней и тип, Clip и усиление ступеней
+    со второй по MAX_CLIP_STAGES. Третий вид графической платы после передаточной
+    функции и спектра, сменяется по щелчку на заголовке. Ряды ступеней
+    сверх Stages выключены. */
+{
+public:
+    StagesPanel(juce::LookAndFeel& lnf, APVTS& apvts, juce::Font& font);
+    void paint(juce::Graphics& g) override;
+    void resized() override;
+    juce::Label label{ "name", "STAGES" };
+private:
+    struct StageRow
+    {
+        juce::Label name;
+        juce::ComboBox typeBox;
+        juce::Slider clipSlider{ juce::Slider::SliderStyle::LinearHorizontal, juce::Slider::TextEntryBoxPosition::TextBoxRight };
+        juce::Slider gainSlider{ juce::Slider::SliderStyle::LinearHorizontal, juce::Slider::TextEntryBoxPosition::TextBoxRight };
+        // после компонентов: вложения удаляются первыми
+        std::unique_ptr<APVTS::ComboBoxAttachment> typeAttach;
+        std::unique_ptr<APVTS::SliderAttachment> clipAttach;
+        std::unique_ptr<APVTS::SliderAttachment> gainAttach;
+    };
+    void updateRows();
+
+    juce::Label stagesLabel{ "Stages", "Stages" };
+    juce::Slider stagesSlider{ juce::Slider::SliderStyle::LinearHorizontal, juce::Slider::TextEntryBoxPosition::TextBoxRight };
+    std::unique_ptr<APVTS::SliderAttachment> stagesAttach;
+    std::array<StageRow, MAX_CLIP_STAGES - 1> rows;
+    float lineThickness{ 2.0f };
+    float cornerSize{ 4.0f };
+};
+//==============================================================================
+class LoadMeterPanel : public juce::Component, public juce::Timer
+    /* Скрытая панель загрузки процессора. Открывается двойным щелчком
+    по номеру версии в заголовке. */
+{
+public:
+    LoadMeterPanel(DestructionAudioProcessor& processor, const EditorOpenTiming& openTiming, juce::Font& font);
+    void paint(juce::Graphics& g) override;
+    void timerCallback() override;
+    void mouseDoubleClick(const juce::MouseEvent& event) override;
+    void visibilityChanged() override;
+private:
+    DestructionAudioProcessor& audioProcessor;
+    const EditorOpenTiming& openTiming;
+    LoadStatistics statistics;
+    juce::Font font;
+};
+//==============================================================================
 class Plate : public juce::Component
 {
     void paint(juce::Graphics& g) override;
@@ -118,7 +263,10 @@ public:
 
     //==============================================================================
     void paint (juce::Graphics&) override;
+    void paintOverChildren(juce::Graphics&) override;
     void resized() override;
+    void mouseUp(const juce::MouseEvent& event) override;
+    void mouseDoubleClick(const juce::MouseEvent& event) override;
     void drawShadows(juce::Graphics& g,
                      juce::Path& path,
                      const juce::Rectangle<int>& bounds,
@@ -127,14 +275,25 @@ public:
                         juce::ColourGradient& gradient,
                         const juce::Rectangle<float>& bounds,
                         std::map<double, juce::Colour>& colors);
+    const EditorOpenTiming& getOpenTiming() const noexcept;
 
 private:
+    void finishOpening();
+    void drawShadowCache();
+
+    const juce::int64 openTicks{ juce::Time::getHighResolutionTicks() }; // первым членом: замер включает конструирование компонентов
+    EditorOpenTiming openTiming;
+    bool openingScheduled{ false };
+    bool opened{ false };
+    juce::SharedResourcePointer<SharedResources> resources; // гарнитура и логотип одни на все окна процесса
     XcytheLookAndFeel_v1 newLNF;
     XcytheRotarySlider inputGainSlider;
     XcytheRotarySlider outputGainSlider;
     XcytheRotarySlider clipSlider;
+    XcytheRotarySlider mixSlider;
     juce::ComboBox clipperBox{ "Clippers" };
     juce::ToggleButton linkButton{ "Link" };
+    juce::ToggleButton autoGainButton{ "Auto" };
     juce::ToggleButton bypassButton{ "Bypass" };
     juce::Label pluginName{ "Destruction" };
     juce::Label version{ "Version"};
@@ -142,16 +301,24 @@ private:
 
     DestructionAudioProcessor& audioProcessor;
     TransientFunctionGraph graph;
+    SpectrumDisplay spectrumDisplay;
     PresetPanel presetPanel;
+    std::unique_ptr<MorphPanel> morphPanel;
+    std::unique_ptr<StagesPanel> stagesPanel;
+    std::unique_ptr<LoadMeterPanel> loadMeterPanel;
     Plate graphPlate, sliderPlate;
     std::unique_ptr<juce::DropShadow> graphPlateShadow, sliderPlateShadow;
+    juce::Image shadowCache; // тени плат рисуются один раз после показа окна
 
     std::unique_ptr<APVTS::SliderAttachment> inputGainAttach;
     std::unique_ptr<APVTS::SliderAttachment> outputGainAttach;
     std::unique_ptr<APVTS::SliderAttachment> clipAttach;
+    std::unique_ptr<APVTS::SliderAttachment> mixAttach;
     std::unique_ptr<APVTS::ButtonAttachment> bypassAttach;
     std::unique_ptr<APVTS::ButtonAttachment> linkAttach;
+    std::unique_ptr<APVTS::ButtonAttachment> autoGainAttach;
     std::unique_ptr<APVTS::ComboBoxAttachment> clipperBoxAttach;
+    std::unique_ptr<APVTS::SliderAttachment> morphAttach;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DestructionAudioProcessorEditor)
 };
@@ -16,6 +16,7 @@ ClipHolder::ClipHolder()
     clippers.push_back(dynamic_cast<Clipper<float>*>(foldbackClipper.get()));
     clippers.push_back(dynamic_cast<Clipper<float>*>(sineFoldClipper.get()));
     clippers.push_back(dynamic_cast<Clipper<float>*>(linearFoldClipper.get()));
+    clippers.push_back(dynamic_cast<Clipper<float>*>(customClipper.get()));
     
     currentClipper = hard; // убрать, когда будет дерево параметров
 }
@@ -23,6 +24,219 @@ ClipHolder::ClipHolder()
 void ClipHolder::setClipper(int newClipper) { currentClipper = newClipper; }
 
 Clipper<float>* ClipHolder::getClipper() const { return clippers[currentClipper]; }
+
+Clipper<float>* ClipHolder::getClipper(int clipperType) const { return clippers[clipperType]; }
+
+CustomClipper<float>* ClipHolder::getCustomClipper() const { return customClipper.get(); }
+
+float ClipHolder::getNormalization(float gain) const noexcept
+{
+    switch (currentClipper)
+    {
+        case hard - 1:       return HardClipper<float>::getNormalization(gain);
+        case soft - 1:       return SoftClipper<float>::getNormalization(gain);
+        case foldback - 1:   return FoldbackClipper<float>::getNormalization(gain);
+        case sinefold - 1:   return SineFoldClipper<float>::getNormalization(gain);
+        case linearfold - 1: return LinearFoldClipper<float>::getNormalization(gain);
+        default:             return CustomClipper<float>::getNormalization(gain);
+    }
+}
+
+float ClipHolder::processSample(float sample, float gain, float normalization) const noexcept
+{
+    /* Прямой вызов закона текущего клиппера без виртуальной диспетчеризации:
+    каскад зовёт его на каждый сэмпл каждой ступени, и переход по switch
+    предсказывается, пока тип ступени не меняется. */
+    switch (currentClipper)
+    {
+        case hard - 1:       return hardClipper->processSample(sample, gain, normalization);
+        case soft - 1:       return softClipper->processSample(sample, gain, normalization);
+        case foldback - 1:   return foldbackClipper->processSample(sample, gain, normalization);
+        case sinefold - 1:   return sineFoldClipper->processSample(sample, gain, normalization);
+        case linearfold - 1: return linearFoldClipper->processSample(sample, gain, normalization);
+        default:             return customClipper->processSample(sample, gain, normalization);
+    }
+}
+//==============================================================================
+SharedResources::SharedResources() { TransferCurve().compile(defaultCurveTable); }
+
+juce::Typeface::Ptr SharedResources::getTypeface()
+{
+    const juce::ScopedLock scopedLock{ lock };
+    if (typeface == nullptr)
+    {
+        typeface = juce::Typeface::createSystemTypefaceFor(BinaryData::MagistralTT_ttf, BinaryData::MagistralTT_ttfSize);
+    }
+    return typeface;
+}
+
+juce::Image SharedResources::getLogo()
+{
+    const juce::ScopedLock scopedLock{ lock };
+    if (!logo.isValid())
+    {
+        logo = juce::ImageFileFormat::loadFrom(BinaryData::Logo_transparent_png, BinaryData::Logo_transparent_pngSize);
+    }
+    return logo;
+}
+
+const CurveTable& SharedResources::getDefaultCurveTable() const noexcept { return defaultCurveTable; }
+//==============================================================================
+const juce::Identifier TransferCurve::curveId{ "CURVE" };
+const juce::Identifier TransferCurve::pointId{ "POINT" };
+
+TransferCurve::TransferCurve()
+{
+    // мягкое колено по умолчанию
+    setPoints({ { 0.0f, 0.0f }, { 0.3f, 0.4f }, { 0.65f, 0.85f }, { 1.0f, 1.0f } });
+}
+
+TransferCurve TransferCurve::fromValueTree(const juce::ValueTree& tree)
+{
+    TransferCurve curve;
+    if (!tree.hasType(curveId)) { return curve; }
+    std::vector<juce::Point<float>> newPoints;
+    for (const auto& child : tree)
+    {
+        if (!child.hasType(pointId)) { continue; }
+        newPoints.push_back({ static_cast<float>(child.getProperty(juce::Identifier("x"))),
+                              static_cast<float>(child.getProperty(juce::Identifier("y"))) });
+    }
+    if (newPoints.size() >= 2) { curve.setPoints(newPoints); }
+    return curve;
+}
+
+juce::ValueTree TransferCurve::toValueTree() const
+{
+    juce::ValueTree tree{ curveId };
+    for (const auto& point : points)
+    {
+        juce::ValueTree child{ pointId };
+        child.setProperty(juce::Identifier("x"), point.x, nullptr);
+        child.setProperty(juce::Identifier("y"), point.y, nullptr);
+        tree.appendChild(child, nullptr);
+    }
+    return tree;
+}
+
+void TransferCurve::setPoints(std::vector<juce::Point<float>> newPoints)
+{
+    /* Точки упорядочиваются по x и приводятся к неубывающей кривой:
+    первая закреплена в нуле, последняя на x = 1, слишком близкие
+    по x точки сливаются, лишние отбрасываются. */
+    if (newPoints.size() < 2)
+    {
+        DBG("Transfer curve needs at least two points");
+        jassertfalse;
+        return;
+    }
+    for (auto& point : newPoints)
+    {
+        point.x = juce::jlimit(0.0f, 1.0f, point.x);
+        point.y = juce::jlimit(0.0f, 1.0f, point.y);
+    }
+    std::sort(newPoints.begin(), newPoints.end(), [](const auto& a, const auto& b) { return a.x < b.x; });
+    newPoints.front() = { 0.0f, 0.0f };
+    newPoints.back().x = 1.0f;
+    const float minDistance{ 0.01f };
+    points.clear();
+    for (size_t i = 0; i < newPoints.size(); ++i)
+    {
+        auto point{ newPoints[i] };
+        if (!points.empty())
+        {
+            point.y = juce::jmax(point.y, points.back().y);
+            if (point.x - points.back().x < minDistance)
+            {
+                if (i + 1 < newPoints.size()) { continue; }
+                if (points.size() > 1) { points.pop_back(); } // последняя точка вытесняет предыдущую
+                else { continue; }
+            }
+        }
+        points.push_back(point);
+    }
+    if (points.size() < 2) { points.push_back({ 1.0f, points.back().y }); }
+    if (points.size() > maxNumPoints)
+    {
+        const auto last{ points.back() };
+        points.resize(maxNumPoints - 1);
+        points.push_back({ last.x, juce::jmax(last.y, points.back().y) });
+    }
+    updateTangents();
+}
+
+const std::vector<juce::Point<float>>& TransferCurve::getPoints() const { return points; }
+
+void TransferCurve::updateTangents()
+{
+    const auto numPoints{ points.size() };
+    std::vector<float> secants(numPoints - 1);
+    for (size_t i = 0; i + 1 < numPoints; ++i)
+    {
+        secants[i] = (points[i + 1].y - points[i].y) / (points[i + 1].x - points[i].x);
+    }
+    tangents.assign(numPoints, 0.0f);
+    tangents.front() = secants.front();
+    tangents.back() = secants.back();
+    for (size_t i = 1; i + 1 < numPoints; ++i)
+    {
+        tangents[i] = secants[i - 1] * secants[i] <= 0.0f ? 0.0f : 0.5f * (secants[i - 1] + secants[i]);
+    }
+    // ограничение Фритча - Карлсона сохраняет монотонность на каждом участке
+    for (size_t i = 0; i + 1 < numPoints; ++i)
+    {
+        if (secants[i] == 0.0f)
+        {
+            tangents[i] = 0.0f;
+            tangents[i + 1] = 0.0f;
+            continue;
+        }
+        const auto alpha{ tangents[i] / secants[i] };
+        const auto beta{ tangents[i + 1] / secants[i] };
+        const auto length{ alpha * alpha + beta * beta };
+        if (length > 9.0f)
+        {
+            const auto scale{ 3.0f / std::sqrt(length) };
+            tangents[i] = scale * alpha * secants[i];
+            tangents[i + 1] = scale * beta * secants[i];
+        }
+    }
+}
+
+float TransferCurve::evaluate(float x) const
+{
+    x = juce::jlimit(0.0f, 1.0f, x);
+    const auto upper{ std::upper_bound(points.begin(), points.end(), x,
+                                       [](float value, const auto& point) { return value < point.x; }) };
+    const auto segment{ static_cast<size_t>(juce::jlimit<std::ptrdiff_t>(0, static_cast<std::ptrdiff_t>(points.size()) - 2,
+                                                                         std::distance(points.begin(), upper) - 1)) };
+    const auto& p0{ points[segment] };
+    const auto& p1{ points[segment + 1] };
+    const auto width{ p1.x - p0.x };
+    const auto t{ (x - p0.x) / width };
+    const auto t2{ t * t };
+    const auto t3{ t2 * t };
+    return (2.0f * t3 - 3.0f * t2 + 1.0f) * p0.y
+         + (t3 - 2.0f * t2 + t) * width * tangents[segment]
+         + (-2.0f * t3 + 3.0f * t2) * p1.y
+         + (t3 - t2) * width * tangents[segment + 1];
+}
+
+void TransferCurve::compile(CurveTable& table) const
+{
+    auto& values{ table.values };
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        values[i] = evaluate(static_cast<float>(i) / static_cast<float>(CURVE_TABLE_SIZE));
+        if (i > 0 && values[i] < values[i - 1])
+        {
+            // сплайн монотонен, допустима лишь погрешность округления
+            jassert(values[i - 1] - values[i] < 1.0e-5f);
+            values[i] = values[i - 1];
+        }
+    }
+    table.curve = *this;
+}
 //==============================================================================
 juce::File PresetManager::defaultDir{ juce::File::getSpecialLocation(
     juce::File::SpecialLocationType::commonDocumentsDirectory)
@@ -31,7 +245,38 @@ juce::File PresetManager::defaultDir{ juce::File::getSpecialLocation(
 
 const juce::String PresetManager::extention{ "prexet" };
 
-PresetManager::PresetManager(APVTS& _apvts, juce::ValueTree& _defaultTree) : apvts(_apvts), defaultTree(_defaultTree)
+ParameterSnapshot ParameterSnapshot::fromValueTree(const juce::ValueTree& tree)
+{
+    ParameterSnapshot snapshot;
+    for (const auto& child : tree)
+    {
+        if (!child.hasType(juce::Identifier("PARAM"))) { continue; }
+        const auto id{ child.getProperty(juce::Identifier("id")).toString() };
+        const double value{ child.getProperty(juce::Identifier("value")) };
+        if (id == "Input Gain") { snapshot.inputGainInDb = value; }
+        else if (id == "Output Gain") { snapshot.outputGainInDb = value; }
+        else if (id == "Clip") { snapshot.clip = value; }
+        else if (id == "Clipper Type") { snapshot.clipperType = static_cast<int>(value); }
+        else if (id == "Bypass") { snapshot.bypassed = value >= 0.5; }
+        else if (id == "Link") { snapshot.linked = value >= 0.5; }
+        else if (id == "Auto Gain") { snapshot.autoGain = value >= 0.5; }
+    }
+    return snapshot;
+}
+
+ParameterSnapshot ParameterSnapshot::interpolate(const ParameterSnapshot& a, const ParameterSnapshot& b, double proportion)
+{
+    // непрерывные параметры интерполируются, дискретные переключаются посередине
+    ParameterSnapshot snapshot{ proportion < 0.5 ? a : b };
+    snapshot.inputGainInDb = a.inputGainInDb + proportion * (b.inputGainInDb - a.inputGainInDb);
+    snapshot.outputGainInDb = a.outputGainInDb + proportion * (b.outputGainInDb - a.outputGainInDb);
+    snapshot.clip = a.clip + proportion * (b.clip - a.clip);
+    snapshot.clipperType = a.clipperType; // тип B подмешивается параллельно в processBlock
+    return snapshot;
+}
+//==============================================================================
+PresetManager::PresetManager(APVTS& _apvts, juce::ValueTree& _defaultTree, SnapshotFifo& _snapshots, MorphFifo& _morphs)
+    : apvts(_apvts), defaultTree(_defaultTree), snapshots(_snapshots), morphs(_morphs)
 {
     if (!defaultDir.exists())
     {
@@ -46,12 +291,16 @@ PresetManager::PresetManager(APVTS& _apvts, juce::ValueTree& _defaultTree) : apv
     currentPreset.referTo(apvts.state.getPropertyAsValue(juce::Identifier("presetName"), nullptr));
 }
 
-PresetManager::~PresetManager() { apvts.state.removeListener(this); }
+PresetManager::~PresetManager()
+{
+    worker.removeAllJobs(true, 5000); // дожидаемся завершения записи файла
+    apvts.state.removeListener(this);
+}
 
 void PresetManager::newPreset()
 {
-    apvts.replaceState(defaultTree.createCopy());
-    currentPreset.setValue("-init-");
+    pendingPreset.clear();
+    applyState(defaultTree.createCopy(), ParameterSnapshot::fromValueTree(defaultTree), "-init-");
 }
 
 void PresetManager::savePreset(const juce::String& presetName)
@@ -59,41 +308,66 @@ void PresetManager::savePreset(const juce::String& presetName)
     if (presetName.isEmpty()) { return; }
     currentPreset.setValue(presetName);
     const juce::File presetToSave{ defaultDir.getChildFile(presetName + "." + extention) };
-    const auto xml{ apvts.state.createXml() };
-    if (xml == nullptr)
-    {
-        DBG("Failed to create XML from current value tree");
-        jassertfalse;
-        return;
-    }
-    if (!xml->writeTo(presetToSave))
-    {
-        DBG("Failed to write XML value tree to preset file");
-        jassertfalse;
-        return;
-    }
-    updatePresetList();
+    const auto stateToSave{ apvts.copyState() };
+    juce::WeakReference<PresetManager> safeThis{ this };
+    worker.addJob([safeThis, presetToSave, stateToSave]()
+        {
+            TRACE_SCOPE("PresetManager::savePreset");
+            const auto xml{ stateToSave.createXml() };
+            if (xml == nullptr)
+            {
+                DBG("Failed to create XML from current value tree");
+                jassertfalse;
+                return;
+            }
+            if (!xml->writeTo(presetToSave))
+            {
+                DBG("Failed to write XML value tree to preset file");
+                jassertfalse;
+                return;
+            }
+            const auto newPresetList{ scanPresetDirectory() };
+            juce::MessageManager::callAsync([safeThis, newPresetList]()
+                {
+                    if (auto* manager{ safeThis.get() })
+                    {
+                        manager->presetList = newPresetList;
+                        manager->sendChangeMessage();
+                    }
+                });
+        });
 }
 
 void PresetManager::loadPreset(const juce::String& presetName)
 {
     if (presetName.isEmpty()) { return; }
+    pendingPreset = presetName;
     const juce::File presetToLoad{ defaultDir.getChildFile(presetName + "." + extention) };
-    if (!presetToLoad.exists())
-    {
-        DBG("Failed to load preset file");
-        jassertfalse;
-        return;
-    }
-    const auto xml{ juce::XmlDocument(presetToLoad).getDocumentElement() };
-    if (xml == nullptr)
-    {
-        DBG("Failed to create XML value tree from loaded preset");
-        jassertfalse;
-        return;
-    }
-    apvts.replaceState(juce::ValueTree::fromXml(*xml));
-    currentPreset.setValue(presetName);
+    juce::WeakReference<PresetManager> safeThis{ this };
+    worker.addJob([safeThis, presetToLoad, presetName]()
+        {
+            TRACE_SCOPE("PresetManager::loadPreset");
+            if (!presetToLoad.exists())
+            {
+                DBG("Failed to load preset file");
+                jassertfalse;
+                return;
+            }
+            const auto xml{ juce::XmlDocument(presetToLoad).getDocumentElement() };
+            if (xml == nullptr)
+            {
+                DBG("Failed to create XML value tree from loaded preset");
+                jassertfalse;
+                return;
+            }
+            // дерево и снимок параметров полностью собираются в фоновом потоке
+            const auto newState{ juce::ValueTree::fromXml(*xml) };
+            const auto snapshot{ ParameterSnapshot::fromValueTree(newState) };
+            juce::MessageManager::callAsync([safeThis, newState, snapshot, presetName]()
+                {
+                    if (auto* manager{ safeThis.get() }) { manager->applyState(newState, snapshot, presetName); }
+                });
+        });
 }
 
 void PresetManager::deletePreset(const juce::String& presetName)
@@ -101,34 +375,59 @@ void PresetManager::deletePreset(const juce::String& presetName)
     if (presetName.isEmpty()) { return; }
     const juce::File presetToDelete{ defaultDir.getChildFile(presetName + "." + extention) };
     if (currentPreset.toString() == "-init-") { return; }
-    if (!presetToDelete.exists())
-    {
-        DBG("Preset is not saved to be deleted");
-        jassertfalse;
-        return;
-    }
-    if (!presetToDelete.deleteFile())
-    {
-        DBG("Failed to delete current preset file");
-        jassertfalse;
-        return;
-    }
-    updatePresetList();
-    currentPreset.setValue("-init-");
-    apvts.replaceState(defaultTree.createCopy());
+    juce::WeakReference<PresetManager> safeThis{ this };
+    worker.addJob([safeThis, presetToDelete]()
+        {
+            TRACE_SCOPE("PresetManager::deletePreset");
+            if (!presetToDelete.exists())
+            {
+                DBG("Preset is not saved to be deleted");
+                jassertfalse;
+                return;
+            }
+            if (!presetToDelete.deleteFile())
+            {
+                DBG("Failed to delete current preset file");
+                jassertfalse;
+                return;
+            }
+            const auto newPresetList{ scanPresetDirectory() };
+            juce::MessageManager::callAsync([safeThis, newPresetList]()
+                {
+                    if (auto* manager{ safeThis.get() })
+                    {
+                        manager->presetList = newPresetList;
+                        manager->newPreset();
+                    }
+                });
+        });
 }
 
-void PresetManager::updatePresetList()
+void PresetManager::updatePresetList() { presetList = scanPresetDirectory(); }
+
+juce::StringArray PresetManager::scanPresetDirectory()
 {
-    presetList.clear(); // нужно чистить перед каждым добавлением элементов
+    juce::StringArray newPresetList;
     const auto fileList{ defaultDir.findChildFiles(juce::File::TypesOfFileToFind::findFiles, false, "*." + extention)};
-    for (const auto& file : fileList) { presetList.add(file.getFileNameWithoutExtension()); }
+    for (const auto& file : fileList) { newPresetList.add(file.getFileNameWithoutExtension()); }
+    return newPresetList;
+}
+
+void PresetManager::applyState(const juce::ValueTree& newState, const ParameterSnapshot& snapshot, const juce::String& presetName)
+{
+    TRACE_SCOPE("PresetManager::applyState");
+    snapshots.push(snapshot); // аудиопоток получит все параметры пресета за один шаг
+    apvts.replaceState(newState);
+    currentPreset.setValue(presetName);
+    if (presetName == pendingPreset) { pendingPreset.clear(); }
+    sendChangeMessage();
 }
 
 int PresetManager::nextPreset()
 {
     if (presetList.isEmpty()) { return -1; }
-    const int currentIndex{ presetList.indexOf(currentPreset.toString()) };
+    // пока пресет грузится в фоне, currentPreset ещё старый: шаг считается от ожидаемого
+    const int currentIndex{ presetList.indexOf(pendingPreset.isNotEmpty() ? pendingPreset : currentPreset.toString()) };
     int nextIndex{ currentIndex >= presetList.size() - 1 ? 0 : currentIndex + 1 };
     loadPreset(presetList.getReference(nextIndex));
     return nextIndex + presetListIdOffset; // смещение для обхода строк New, Load, Save, Delete в комбобоксе
@@ -137,12 +436,60 @@ int PresetManager::nextPreset()
 int PresetManager::previousPreset()
 {
     if (presetList.isEmpty()) { return -1; }
-    const int currentIndex{ presetList.indexOf(currentPreset.toString()) };
+    const int currentIndex{ presetList.indexOf(pendingPreset.isNotEmpty() ? pendingPreset : currentPreset.toString()) };
     int prevIndex{ currentIndex <= 0 ? presetList.size() - 1 : currentIndex - 1 };
     loadPreset(presetList.getReference(prevIndex));
     return prevIndex + presetListIdOffset;
 }
 
+void PresetManager::setMorphEndpoint(int slot, const juce::String& presetName)
+{
+    jassert(slot == 0 || slot == 1);
+    if (presetName.isEmpty() || presetName == "-init-")
+    {
+        applyMorphEndpoint(slot, ParameterSnapshot::fromValueTree(defaultTree), "-init-");
+        return;
+    }
+    const juce::File presetToLoad{ defaultDir.getChildFile(presetName + "." + extention) };
+    juce::WeakReference<PresetManager> safeThis{ this };
+    worker.addJob([safeThis, presetToLoad, presetName, slot]()
+        {
+            TRACE_SCOPE("PresetManager::setMorphEndpoint");
+            const auto xml{ juce::XmlDocument(presetToLoad).getDocumentElement() };
+            if (xml == nullptr)
+            {
+                DBG("Failed to decode morph preset");
+                jassertfalse;
+                return;
+            }
+            const auto snapshot{ ParameterSnapshot::fromValueTree(juce::ValueTree::fromXml(*xml)) };
+            juce::MessageManager::callAsync([safeThis, snapshot, presetName, slot]()
+                {
+                    if (auto* manager{ safeThis.get() }) { manager->applyMorphEndpoint(slot, snapshot, presetName); }
+                });
+        });
+}
+
+void PresetManager::clearMorph()
+{
+    morphNames.fill({});
+    morphEndpoints.active = false;
+    morphs.push(morphEndpoints);
+    sendChangeMessage();
+}
+
+juce::String PresetManager::getMorphEndpointName(int slot) const { return morphNames[static_cast<size_t>(slot)]; }
+
+void PresetManager::applyMorphEndpoint(int slot, const ParameterSnapshot& snapshot, const juce::String& presetName)
+{
+    if (slot == 0) { morphEndpoints.a = snapshot; }
+    else { morphEndpoints.b = snapshot; }
+    morphNames[static_cast<size_t>(slot)] = presetName;
+    morphEndpoints.active = morphNames[0].isNotEmpty() && morphNames[1].isNotEmpty();
+    morphs.push(morphEndpoints);
+    sendChangeMessage();
+}
+
 void PresetManager::valueTreeRedirected(juce::ValueTree& changedTree)
 {
     currentPreset.referTo(changedTree.getPropertyAsValue(juce::Identifier("presetName"), nullptr));
@@ -154,6 +501,7 @@ DestructionAudioProcessor::DestructionAudioProcessor()
     #if ! JucePlugin_IsMidiEffect
         #if ! JucePlugin_IsSynth
                 .withInput("Input", juce::AudioChannelSet::stereo(), true)
+                .withInput("Sidechain", juce::AudioChannelSet::stereo(), false)
         #endif
             .withOutput("Output", juce::AudioChannelSet::stereo(), true)
     #endif
@@ -163,13 +511,62 @@ DestructionAudioProcessor::DestructionAudioProcessor()
 {
     apvts.state.setProperty(juce::Identifier("presetName"), "-init-", nullptr);
     apvts.state.setProperty(juce::Identifier("version"), ProjectInfo::versionString, nullptr);
+    apvts.state.appendChild(TransferCurve().toValueTree(), nullptr);
     defaultTree = apvts.copyState(); // сохранение дефолтного дерева для функции создания нового пресета
-    manager = std::make_unique<PresetManager>(apvts, defaultTree);
+    morphParameter = apvts.getRawParameterValue("Morph");
+    inputGainParameter = apvts.getRawParameterValue("Input Gain");
+    outputGainParameter = apvts.getRawParameterValue("Output Gain");
+    clipParameter = apvts.getRawParameterValue("Clip");
+    bypassParameter = apvts.getRawParameterValue("Bypass");
+    linkParameter = apvts.getRawParameterValue("Link");
+    clipperTypeParameter = apvts.getRawParameterValue("Clipper Type");
+    numStagesParameter = apvts.getRawParameterValue("Stages");
+    autoGainParameter = apvts.getRawParameterValue("Auto Gain");
+    analysisThread->addTimeSliceClient(&loudnessMatcher);
+    analysisThread->addTimeSliceClient(&spectrum);
+    analysisThread->addTimeSliceClient(&harmonicAnalysis);
+    limiterParameter = apvts.getRawParameterValue("Limiter");
+    limiterCeilingParameter = apvts.getRawParameterValue("Limiter Ceiling");
+    limiterReleaseParameter = apvts.getRawParameterValue("Limiter Release");
+    governorParameter = apvts.getRawParameterValue("CPU Governor");
+    mixParameter = apvts.getRawParameterValue("Mix");
+    emphasisParameter = apvts.getRawParameterValue("Emphasis");
+    emphasisFrequencyParameter = apvts.getRawParameterValue("Emphasis Frequency");
+    sidechainDriveParameter = apvts.getRawParameterValue("Sidechain Drive");
+    sidechainAttackParameter = apvts.getRawParameterValue("Sidechain Attack");
+    sidechainReleaseParameter = apvts.getRawParameterValue("Sidechain Release");
+    transientSplitParameter = apvts.getRawParameterValue("Transient Split");
+    transientClipParameter = apvts.getRawParameterValue("Transient Clip");
+    modulationTargetParameter = apvts.getRawParameterValue("Mod Target");
+    modulationShapeParameter = apvts.getRawParameterValue("Mod Shape");
+    modulationRateParameter = apvts.getRawParameterValue("Mod Rate");
+    modulationDepthParameter = apvts.getRawParameterValue("Mod Depth");
+    for (size_t i = 0; i < modulationStepParameters.size(); ++i)
+    {
+        modulationStepParameters[i] = apvts.getRawParameterValue("Mod Step " + juce::String(static_cast<int>(i) + 1));
+    }
+    for (size_t i = 0; i < extraStages.size(); ++i)
+    {
+        const auto prefix{ "Stage " + juce::String(static_cast<int>(i) + 2) + " " };
+        extraStages[i].typeParameter = apvts.getRawParameterValue(prefix + "Type");
+        extraStages[i].clipParameter = apvts.getRawParameterValue(prefix + "Clip");
+        extraStages[i].gainParameter = apvts.getRawParameterValue(prefix + "Gain");
+    }
+    manager = std::make_unique<PresetManager>(apvts, defaultTree, presetSnapshots, morphFifo);
     manager->updatePresetList();
+    apvts.state.addListener(this);
+    compileCustomCurve();
+    for (auto& value : midiParameterValues) { value.store(-1.0f); }
+    startTimerHz(30);
 }
 
 DestructionAudioProcessor::~DestructionAudioProcessor()
 {
+    stopTimer();
+    analysisThread->removeTimeSliceClient(&loudnessMatcher);
+    analysisThread->removeTimeSliceClient(&spectrum);
+    analysisThread->removeTimeSliceClient(&harmonicAnalysis);
+    apvts.state.removeListener(this);
 }
 
 //==============================================================================
@@ -237,20 +634,68 @@ void DestructionAudioProcessor::changeProgramName (int index, const juce::String
 //==============================================================================
 void DestructionAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    fifo.prepare(samplesPerBlock, getNumInputChannels());
+    #if OSC
         juce::dsp::ProcessSpec spec;
         spec.maximumBlockSize = samplesPerBlock;
         spec.numChannels = getNumInputChannels();
         spec.sampleRate = sampleRate;
-    #if OSC
         osc.initialise([](float x) { return std::sin(x); });
         osc.prepare(spec);
         osc.setFrequency(220.0f);
     #endif
-        inputGain.prepare(spec);
-        inputGain.setGainDecibels(static_cast<float>(gainController.getInputGainLevelInDb()));
-        outputGain.prepare(spec);
-        outputGain.setGainDecibels(static_cast<float>(gainController.getOutputGainLevelInDb()));
+        loadMeter.prepare(sampleRate, samplesPerBlock);
+        morphPosition.reset(sampleRate, 0.05);
+        morphPosition.setCurrentAndTargetValue(morphParameter->load());
+        maxSegmentSize = juce::jmax(1, samplesPerBlock);
+        morphWeights.assign(static_cast<size_t>(samplesPerBlock), 0.0f);
+        morphScratch.assign(static_cast<size_t>(samplesPerBlock), 0.0f);
+        loudnessMatcher.prepare(sampleRate);
+        spectrum.prepare(sampleRate);
+        autoGainCompensation.reset(sampleRate, 0.2);
+        autoGainCompensation.setCurrentAndTargetValue(juce::Decibels::decibelsToGain(autoGainParameter->load() >= 0.5f ? loudnessMatcher.getCompensationInDb() : 0.0f));
+        outputGains.assign(static_cast<size_t>(samplesPerBlock), 1.0f);
+        limiter.prepare(sampleRate, getTotalNumOutputChannels());
+        limiterWasEnabled = limiterParameter->load() >= 0.5f;
+        /* Латентность лимитера заявляется всегда: выключенный лимитер задерживает
+        сигнал на столько же, поэтому компенсация задержки в хосте не меняется
+        при переключении и латентность задаётся только здесь. */
+        setLatencySamples(limiter.getLatencyInSamples());
+        /* Сухая ветвь задерживается на латентность стадий до точки смешивания:
+        заявленная латентность минус латентность стадий после неё. Лимитер
+        стоит после смешивания и задерживает обе ветви одинаково. Задержка
+        пересчитывается здесь же, где меняется латентность. */
+        const int postMixLatency{ limiter.getLatencyInSamples() };
+        const int preMixLatency{ juce::jmax(0, getLatencySamples() - postMixLatency) };
+        dryDelay.prepare(getTotalNumInputChannels(), samplesPerBlock, preMixLatency);
+        dryDelay.setDelay(preMixLatency);
+        dryCaptured = false;
+        mixPosition.reset(sampleRate, 0.05);
+        mixPosition.setCurrentAndTargetValue(mixParameter->load());
+        mixWeights.assign(static_cast<size_t>(samplesPerBlock), 1.0f);
+        emphasis.prepare(sampleRate, juce::jmax(getTotalNumInputChannels(), getTotalNumOutputChannels()), samplesPerBlock);
+        emphasisWasActive = false;
+        sidechainFollower.prepare(sampleRate);
+        sidechainWasActive = false;
+        driveGains.assign(static_cast<size_t>(samplesPerBlock), 1.0f);
+        morphDriveGains.assign(static_cast<size_t>(samplesPerBlock), 1.0f);
+        for (auto& stage : extraStages)
+        {
+            stage.clip.reset(sampleRate, 0.05);
+            stage.clip.setCurrentAndTargetValue(stage.clipParameter->load());
+            stage.gain.reset(sampleRate, 0.05);
+            stage.gain.setCurrentAndTargetValue(juce::Decibels::decibelsToGain(stage.gainParameter->load()));
+            stage.multipliers.assign(static_cast<size_t>(samplesPerBlock), 1.0f);
+            stage.normalizations.assign(static_cast<size_t>(samplesPerBlock), 1.0f);
+            stage.gains.assign(static_cast<size_t>(samplesPerBlock), 1.0f);
+        }
+        transientDetector.prepare(sampleRate);
+        transientWasActive = false;
+        transientWeights.assign(static_cast<size_t>(samplesPerBlock), 0.0f);
+        modulation.prepare(sampleRate, samplesPerBlock);
+        modulationValues.assign(static_cast<size_t>(samplesPerBlock), 0.0f);
+        governor.prepare(sampleRate);
+        analysisBlockCounter = 0;
+        applyQualityProfile(isNonRealtime() ? QualityProfile::offline() : QualityProfile::realtime());
 }
 
 void DestructionAudioProcessor::releaseResources()
@@ -278,6 +723,13 @@ bool DestructionAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
    #if ! JucePlugin_IsSynth
     if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
         return false;
+
+    // сайдчейн необязателен: отключён, моно или стерео
+    if (layouts.inputBuses.size() > 1
+     && !layouts.inputBuses[1].isDisabled()
+     && layouts.inputBuses[1] != juce::AudioChannelSet::mono()
+     && layouts.inputBuses[1] != juce::AudioChannelSet::stereo())
+        return false;
    #endif
 
     return true;
@@ -285,11 +737,81 @@ bool DestructionAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
 }
 #endif
 
-void DestructionAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+void DestructionAudioProcessor::processBlock (juce::AudioBuffer<float>& hostBuffer, juce::MidiBuffer& midiMessages)
 {
+    REALTIME_SCOPE;
     juce::ScopedNoDenormals noDenormals;
-    auto totalNumInputChannels  = getTotalNumInputChannels();
-    auto totalNumOutputChannels = getTotalNumOutputChannels();
+    TRACE_SCOPE("processBlock");
+    loadMeter.beginBlock();
+    // дальше обрабатывается только основная шина, каналы сайдчейна читаются отдельно
+    auto buffer{ getBusBuffer(hostBuffer, false, 0) };
+    auto sidechain{ getBusBuffer(hostBuffer, true, 1) };
+    const auto numSamples{ buffer.getNumSamples() };
+    // при выключении регулятора качество сразу возвращается к полному
+    const bool governorEnabled{ governorParameter->load() >= 0.5f };
+    if (!governorEnabled && governor.getLevel() != 0)
+    {
+        governor.reset();
+        if (!quality.isOffline) { applyQualityProfile(QualityProfile::realtime()); }
+    }
+    // некоторые хосты переключают офлайн-рендер без повторного prepareToPlay
+    if (isNonRealtime() != quality.isOffline)
+    {
+        applyQualityProfile(isNonRealtime() ? QualityProfile::offline() : QualityGovernor::getProfile(governor.getLevel()));
+    }
+    // настройки модуляции берутся раз на блок хоста, значения считает каждый кусок со своего segmentOffset
+    modulationTarget = static_cast<int>(modulationTargetParameter->load());
+    if (modulationTarget != ModulationEngine::off)
+    {
+        modulation.setShape(static_cast<int>(modulationShapeParameter->load()));
+        modulation.setRate(static_cast<int>(modulationRateParameter->load()));
+        modulation.setDepth(modulationDepthParameter->load());
+        for (size_t i = 0; i < modulationStepParameters.size(); ++i) { modulation.setStep(static_cast<int>(i), modulationStepParameters[i]->load()); }
+    }
+    jassert(maxSegmentSize > 0); // processBlock до prepareToPlay
+    segmentOffset = 0;
+    if (midiMessages.isEmpty() && numSamples <= maxSegmentSize) { processSegment(buffer, sidechain); }
+    else
+    {
+        /* Блок режется по меткам MIDI-событий, чтобы Clip, тип клиппера
+        и байпас менялись с точностью до сэмпла. Куски короче
+        минимального размера из профиля качества не создаются: события внутри
+        первых minSubBlockSize сэмплов куска применяются в его начале, чтобы
+        блочные ядра не вырождались в обработку по одному сэмплу. Событие
+        ближе к концу блока всё равно режет блок точно по своей метке:
+        хвост короче минимума дешевле, чем опоздавшее изменение параметра.
+        Блок длиннее обещанного в prepareToPlay режется ещё и по maxSegmentSize,
+        чтобы рабочие буферы, выделенные под этот размер, всегда хватали. */
+        auto event{ midiMessages.cbegin() };
+        int start{ 0 };
+        while (start < numSamples)
+        {
+            for (; event != midiMessages.cend() && (*event).samplePosition < start + quality.minSubBlockSize; ++event)
+            {
+                handleMidiEvent((*event).getMessage());
+            }
+            const auto end{ juce::jmin(start + maxSegmentSize,
+                                       event != midiMessages.cend() ? juce::jmin(numSamples, (*event).samplePosition) : numSamples) };
+            juce::AudioBuffer<float> segment{ buffer.getArrayOfWritePointers(), buffer.getNumChannels(), start, end - start };
+            const juce::AudioBuffer<float> sidechainSegment{ sidechain.getArrayOfWritePointers(), sidechain.getNumChannels(),
+                                                             start, end - start };
+            segmentOffset = start;
+            processSegment(segment, sidechainSegment);
+            start = end;
+        }
+        // события с меткой за концом блока (так шлют некоторые хосты) применяются после него
+        for (; event != midiMessages.cend(); ++event) { handleMidiEvent((*event).getMessage()); }
+    }
+    loadMeter.endBlock(numSamples);
+    // офлайн-рендер не ограничен по времени, регулятор работает только при воспроизведении
+    if (governorEnabled && !quality.isOffline && governor.update(loadMeter.getLastLoad(), numSamples))
+    {
+        applyQualityProfile(QualityGovernor::getProfile(governor.getLevel()));
+    }
+}
+
+void DestructionAudioProcessor::processSegment(juce::AudioBuffer<float>& buffer, const juce::AudioBuffer<float>& sidechain)
+{
     #if OSC
         auto numSamples = buffer.getNumSamples();
         buffer.clear();
@@ -301,65 +823,444 @@ void DestructionAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
             buffer.setSample(1, i, sample2);
         }
     #endif
+    jassert(buffer.getNumSamples() <= maxSegmentSize); // processBlock режет блоки длиннее подготовленного
+    if (modulationTarget != ModulationEngine::off)
+    {
+        TRACE_SCOPE("processBlock/modulation");
+        modulation.generate(getPlayHead(), segmentOffset, buffer.getNumSamples());
+    }
+    if (curveTables.update())
+    {
+        clipHolder.getCustomClipper()->setTable(&curveTables.getReadBuffer());
+        for (auto& stage : extraStages) { stage.clipHolder.getCustomClipper()->setTable(&curveTables.getReadBuffer()); }
+    }
+    ParameterSnapshot snapshot;
+    bool snapshotReceived{ false };
+    while (presetSnapshots.pull(snapshot)) { snapshotReceived = true; } // нужен только последний снимок
+    if (snapshotsOverflowed.exchange(false))
+    {
+        snapshot = makeParameterSnapshot(); // последний снимок не поместился, параметры читаются напрямую
+        snapshotReceived = true;
+    }
+    if (snapshotReceived) { applyParameterSnapshot(snapshot); }
+    bool morphEndpointsReceived{ false };
+    while (morphFifo.pull(morph)) { morphEndpointsReceived = true; }
+    /* Морфинг: параметры интерполируются поблочно, тип клиппера B подмешивается посэмплово.
+    Снимок применяется только пока идёт переход (новые точки A/B или движение Morph),
+    после него ручки пользователя не перезаписываются каждый блок. */
+    Clipper<float>* morphClipper{ nullptr };
+    morphPosition.setTargetValue(morphParameter->load());
+    if (morph.active)
+    {
+        const bool morphTransition{ morphEndpointsReceived || morphPosition.isSmoothing() };
+        for (int i = 0; i < buffer.getNumSamples(); ++i) { morphWeights[static_cast<size_t>(i)] = morphPosition.getNextValue(); }
+        const auto interpolated{ ParameterSnapshot::interpolate(morph.a, morph.b, morphPosition.getCurrentValue()) };
+        if (morphTransition) { applyParameterSnapshot(interpolated); }
+        if (morph.a.clipperType != morph.b.clipperType)
+        {
+            morphClipper = clipHolder.getClipper(morph.b.clipperType);
+            morphClipper->updateMultiplier(interpolated.clip);
+        }
+    }
+    else { morphPosition.skip(buffer.getNumSamples()); }
+    // параллельный клиппинг: сухая ветвь снимается до входного усиления
+    mixPosition.setTargetValue(mixParameter->load());
+    const bool mixSmoothing{ mixPosition.isSmoothing() };
+    const bool mixModulated{ modulationTarget == ModulationEngine::mix };
+    const bool mixPerSample{ mixSmoothing || mixModulated };
+    const bool mixing{ mixPerSample || mixPosition.getTargetValue() < 1.0f };
+    if (mixing)
+    {
+        TRACE_SCOPE("processBlock/dryCapture");
+        if (!dryCaptured) { dryDelay.reset(); }
+        dryDelay.capture(buffer);
+        auto* weights{ mixWeights.data() };
+        if (mixSmoothing)
+        {
+            for (int i = 0; i < buffer.getNumSamples(); ++i) { weights[i] = mixPosition.getNextValue(); }
+        }
+        else if (mixModulated) { juce::FloatVectorOperations::fill(weights, mixPosition.getCurrentValue(), buffer.getNumSamples()); }
+        if (mixModulated)
+        {
+            modulation.render(0, buffer.getNumSamples(), modulationValues.data(), [](float value) { return value; });
+            juce::FloatVectorOperations::add(weights, modulationValues.data(), buffer.getNumSamples());
+            juce::FloatVectorOperations::clip(weights, weights, 0.0f, 1.0f, buffer.getNumSamples());
+        }
+    }
+    else { mixPosition.skip(buffer.getNumSamples()); }
+    dryCaptured = mixing;
     // указываем условный порог магнитуды в 0,05 чтобы снизить нагрузку на процессор на холостом ходе
     if (!gainController.getBypassState() && buffer.getMagnitude(0, buffer.getNumSamples()) >= 0.00001)
     {
+        const bool autoGainEnabled{ autoGainParameter->load() >= 0.5f };
+        // под нагрузкой регулятор прореживает замеры громкости, интегралу в несколько секунд этого хватает
+        const bool loudnessTap{ autoGainEnabled && ++analysisBlockCounter >= quality.analysisInterval };
+        if (loudnessTap) { analysisBlockCounter = 0; }
         // input gain
-        auto audioBlock{ juce::dsp::AudioBlock<float>(buffer) };
-        auto gainContext{ juce::dsp::ProcessContextReplacing<float>(audioBlock) };
-        inputGain.setGainDecibels(static_cast<float>(gainController.getInputGainLevelInDb()));
-        inputGain.process(gainContext);
+        double inputEnergy{ 0.0 }; // энергия входа для замера громкости снимается в том же проходе, что и усиление
+        {
+            TRACE_SCOPE("processBlock/inputGain");
+            const auto inputGainLinear{ juce::Decibels::decibelsToGain(static_cast<float>(gainController.getInputGainLevelInDb())) };
+            const bool inputGainModulated{ modulationTarget == ModulationEngine::inputGain };
+            if (inputGainModulated)
+            {
+                // ±12 дБ на полной глубине, перевод в усиление на управляющей частоте
+                modulation.render(0, buffer.getNumSamples(), modulationValues.data(),
+                                  [inputGainLinear](float value) { return inputGainLinear * juce::Decibels::decibelsToGain(12.0f * value); });
+            }
+            for (int i = 0; i < buffer.getNumChannels(); ++i)
+            {
+                auto* samples{ buffer.getWritePointer(i) };
+                float channelEnergy{ 0.0f };
+                for (int j = 0; j < buffer.getNumSamples(); ++j)
+                {
+                    channelEnergy += samples[j] * samples[j];
+                    samples[j] *= inputGainModulated ? modulationValues[static_cast<size_t>(j)] : inputGainLinear;
+                }
+                inputEnergy += static_cast<double>(channelEnergy);
+            }
+        }
+        loadMeter.markStage(inputGainStage);
+        const bool spectrumActive{ spectrum.isActive() };
+        if (spectrumActive)
+        {
+            spectrum.push(preClipTap, buffer);
+            loadMeter.markStage(analysisStage);
+        }
 
         // clipping process
         auto numOfSamples = buffer.getNumSamples();
         auto numOfChannels = buffer.getNumChannels();
-        float* sample = new float(0.0f);
+        auto* clipper{ clipHolder.getClipper() };
+        const auto numOfExtraStages{ juce::jlimit(0, static_cast<int>(extraStages.size()),
+                                                  static_cast<int>(numStagesParameter->load()) - 1) };
+        for (int stage = 0; stage < static_cast<int>(extraStages.size()); ++stage)
+        {
+            auto& clipStage{ extraStages[static_cast<size_t>(stage)] };
+            const auto gain{ juce::Decibels::decibelsToGain(clipStage.gainParameter->load()) };
+            if (stage >= numOfExtraStages)
+            {
+                // выключенная ступень включается сразу с текущими значениями, без сглаживания от старых
+                clipStage.clip.setCurrentAndTargetValue(clipStage.clipParameter->load());
+                clipStage.gain.setCurrentAndTargetValue(gain);
+                continue;
+            }
+            clipStage.clipHolder.setClipper(static_cast<int>(clipStage.typeParameter->load()));
+            const auto* stageClipper{ clipStage.clipHolder.getClipper() };
+            clipStage.clip.setTargetValue(clipStage.clipParameter->load());
+            clipStage.gain.setTargetValue(gain);
+            if (clipStage.clip.isSmoothing())
+            {
+                for (int j = 0; j < numOfSamples; ++j)
+                {
+                    const auto multiplier{ static_cast<float>(stageClipper->getMultiplierFor(static_cast<double>(clipStage.clip.getNextValue()))) };
+                    clipStage.multipliers[static_cast<size_t>(j)] = multiplier;
+                    clipStage.normalizations[static_cast<size_t>(j)] = clipStage.clipHolder.getNormalization(multiplier);
+                }
+            }
+            else
+            {
+                const auto multiplier{ static_cast<float>(stageClipper->getMultiplierFor(static_cast<double>(clipStage.clip.getCurrentValue()))) };
+                juce::FloatVectorOperations::fill(clipStage.multipliers.data(), multiplier, numOfSamples);
+                juce::FloatVectorOperations::fill(clipStage.normalizations.data(), clipStage.clipHolder.getNormalization(multiplier), numOfSamples);
+            }
+            if (clipStage.gain.isSmoothing())
+            {
+                for (int j = 0; j < numOfSamples; ++j) { clipStage.gains[static_cast<size_t>(j)] = clipStage.gain.getNextValue(); }
+            }
+            else { juce::FloatVectorOperations::fill(clipStage.gains.data(), clipStage.gain.getCurrentValue(), numOfSamples); }
+        }
+        emphasis.setTilt(emphasisParameter->load(), emphasisFrequencyParameter->load(), numOfSamples);
+        const bool emphasisActive{ emphasis.isActive() };
+        if (emphasisActive && !emphasisWasActive) { emphasis.reset(); }
+        emphasisWasActive = emphasisActive;
+        /* Динамический драйв: огибающая сайдчейна плавно ведёт множитель первой
+        ступени от 1 до Sidechain Drive. Ядро нормирует каждый сэмпл по его
+        множителю, поэтому драйв сдвигает кривую, как поворот Clip, а не
+        выталкивает выход за ±1. */
+        const auto sidechainDriveInDb{ sidechainDriveParameter->load() };
+        const bool sidechainActive{ sidechain.getNumChannels() > 0 && sidechainDriveInDb != 0.0f };
+        if (sidechainActive)
+        {
+            TRACE_SCOPE("processBlock/sidechain");
+            if (!sidechainWasActive) { sidechainFollower.reset(); }
+            sidechainFollower.setAttackInMs(sidechainAttackParameter->load());
+            sidechainFollower.setReleaseInMs(sidechainReleaseParameter->load());
+            sidechainFollower.process(sidechain, driveGains.data(), numOfSamples);
+            juce::FloatVectorOperations::min(driveGains.data(), driveGains.data(), 1.0f, numOfSamples);
+            juce::FloatVectorOperations::multiply(driveGains.data(), juce::Decibels::decibelsToGain(sidechainDriveInDb) - 1.0f, numOfSamples);
+            juce::FloatVectorOperations::add(driveGains.data(), 1.0f, numOfSamples);
+        }
+        sidechainWasActive = sidechainActive;
+        /* Разделение транзиентов: транзиенты клиппируются с Transient Clip,
+        остальное с Clip. Множитель первой ступени посэмплово сдвигается
+        к множителю для Transient Clip пропорционально весу транзиента. */
+        const bool transientActive{ transientSplitParameter->load() >= 0.5f };
+        if (transientActive)
+        {
+            TRACE_SCOPE("processBlock/transientSplit");
+            if (!transientWasActive) { transientDetector.reset(); }
+            transientDetector.process(buffer, transientWeights.data(), numOfSamples);
+            const auto ratio{ clipper->getMultiplierFor(static_cast<double>(transientClipParameter->load())) / clipper->getMultiplier() };
+            auto* weights{ transientWeights.data() };
+            juce::FloatVectorOperations::multiply(weights, static_cast<float>(ratio - 1.0), numOfSamples);
+            juce::FloatVectorOperations::add(weights, 1.0f, numOfSamples);
+            if (sidechainActive) { juce::FloatVectorOperations::multiply(driveGains.data(), weights, numOfSamples); }
+            else { juce::FloatVectorOperations::copy(driveGains.data(), weights, numOfSamples); }
+        }
+        transientWasActive = transientActive;
+        const bool clipModulated{ modulationTarget == ModulationEngine::clip };
+        if (clipModulated)
+        {
+            // Clip качается на ±9 на полной глубине; отношение множителей считается на управляющей частоте
+            const auto baseClip{ clipper->getClip() };
+            const auto baseMultiplier{ clipper->getMultiplier() };
+            modulation.render(0, numOfSamples, modulationValues.data(), [clipper, baseClip, baseMultiplier](float value)
+            {
+                const auto clip{ juce::jlimit(1.0, 10.0, baseClip + 9.0 * value) };
+                return static_cast<float>(clipper->getMultiplierFor(clip) / baseMultiplier);
+            });
+            if (morphClipper != nullptr)
+            {
+                /* Клиппер B морфинга пересчитывает Clip в множитель по своему закону,
+                поэтому отношение A ему не подходит: его ядро нормировалось бы
+                по множителю, которому не соответствует ни одно значение Clip. */
+                const auto morphBaseClip{ morphClipper->getClip() };
+                const auto morphBaseMultiplier{ morphClipper->getMultiplier() };
+                modulation.render(0, numOfSamples, morphDriveGains.data(), [morphClipper, morphBaseClip, morphBaseMultiplier](float value)
+                {
+                    const auto clip{ juce::jlimit(1.0, 10.0, morphBaseClip + 9.0 * value) };
+                    return static_cast<float>(morphClipper->getMultiplierFor(clip) / morphBaseMultiplier);
+                });
+                if (sidechainActive || transientActive) { juce::FloatVectorOperations::multiply(morphDriveGains.data(), driveGains.data(), numOfSamples); }
+            }
+            if (sidechainActive || transientActive) { juce::FloatVectorOperations::multiply(driveGains.data(), modulationValues.data(), numOfSamples); }
+            else { juce::FloatVectorOperations::copy(driveGains.data(), modulationValues.data(), numOfSamples); }
+        }
+        const bool modulated{ sidechainActive || transientActive || clipModulated };
         for (int i = 0; i < numOfChannels; ++i)
         {
-            for (int j = 0; j < numOfSamples; ++j)
+            TRACE_SCOPE("processBlock/clipping");
+            auto* samples{ buffer.getWritePointer(i) };
+            if (emphasisActive) { emphasis.processPre(i, samples, numOfSamples); }
+            if (morphClipper != nullptr)
+            {
+                auto* scratch{ morphScratch.data() };
+                juce::FloatVectorOperations::copy(scratch, samples, numOfSamples);
+                const auto* morphGains{ clipModulated ? morphDriveGains.data() : driveGains.data() };
+                if (modulated) { morphClipper->processModulatedBlock(scratch, morphGains, numOfSamples); }
+                else { morphClipper->processBlock(scratch, numOfSamples); }
+            }
+            if (modulated) { clipper->processModulatedBlock(samples, driveGains.data(), numOfSamples); }
+            else { clipper->processBlock(samples, numOfSamples); }
+            if (morphClipper != nullptr || numOfExtraStages > 0)
             {
-                *sample = buffer.getSample(i, j);
-                buffer.setSample(i, j, clipHolder.getClipper()->process(*sample));
+                /* Смешивание морфинга и все дополнительные ступени - один проход:
+                сэмпл проходит весь каскад в регистре, а не возвращается
+                в буфер после каждой ступени, как при цепочке отдельных экземпляров. */
+                for (int j = 0; j < numOfSamples; ++j)
+                {
+                    const auto index{ static_cast<size_t>(j) };
+                    auto sample{ samples[j] };
+                    if (morphClipper != nullptr) { sample += morphWeights[index] * (morphScratch[index] - sample); }
+                    for (int stage = 0; stage < numOfExtraStages; ++stage)
+                    {
+                        const auto& clipStage{ extraStages[static_cast<size_t>(stage)] };
+                        sample = clipStage.clipHolder.processSample(sample * clipStage.gains[index],
+                                                                    clipStage.multipliers[index],
+                                                                    clipStage.normalizations[index]);
+                    }
+                    samples[j] = sample;
+                }
             }
+            if (emphasisActive) { emphasis.processPost(i, samples, numOfSamples); }
+        }
+        loadMeter.markStage(clippingStage);
+        if (spectrumActive)
+        {
+            spectrum.push(postClipTap, buffer);
+            loadMeter.markStage(analysisStage);
         }
-        delete sample;
-        sample = nullptr;
 
         // output gain
-        outputGain.setGainDecibels(static_cast<float>(gainController.getOutputGainLevelInDb()));
-        outputGain.process(gainContext);
+        {
+            TRACE_SCOPE("processBlock/outputGain");
+            /* Компенсация громкости идёт посэмпловой рампой, при автокомпенсации
+            Output Gain работает как подстройка поверх неё. Энергия обработанного
+            сигнала для замера громкости снимается в том же проходе. */
+            const auto outputGainLinear{ juce::Decibels::decibelsToGain(static_cast<float>(gainController.getOutputGainLevelInDb())) };
+            autoGainCompensation.setTargetValue(juce::Decibels::decibelsToGain(autoGainEnabled ? loudnessMatcher.getCompensationInDb() : 0.0f));
+            auto* wetGains{ outputGains.data() };
+            if (autoGainCompensation.isSmoothing())
+            {
+                for (int j = 0; j < numOfSamples; ++j) { wetGains[j] = outputGainLinear * autoGainCompensation.getNextValue(); }
+            }
+            else { juce::FloatVectorOperations::fill(wetGains, outputGainLinear * autoGainCompensation.getCurrentValue(), numOfSamples); }
+            if (mixing && !mixPerSample) { juce::FloatVectorOperations::fill(mixWeights.data(), mixPosition.getCurrentValue(), numOfSamples); }
+            double outputEnergy{ 0.0 };
+            for (int i = 0; i < numOfChannels; ++i)
+            {
+                auto* wet{ buffer.getWritePointer(i) };
+                float channelEnergy{ 0.0f };
+                if (!mixing)
+                {
+                    for (int j = 0; j < numOfSamples; ++j)
+                    {
+                        channelEnergy += wet[j] * wet[j];
+                        wet[j] *= wetGains[j];
+                    }
+                }
+                else
+                {
+                    /* Смешивание совмещено с умножением на выходное усиление, отдельного
+                    прохода по буферу нет. Компенсация громкости относится только
+                    к обработанной ветви, Output Gain - к сумме. */
+                    const auto* dry{ dryDelay.getReadPointer(i) };
+                    for (int j = 0; j < numOfSamples; ++j)
+                    {
+                        const auto weight{ mixWeights[static_cast<size_t>(j)] };
+                        channelEnergy += wet[j] * wet[j];
+                        wet[j] = weight * wetGains[j] * wet[j] + (1.0f - weight) * outputGainLinear * dry[j];
+                    }
+                }
+                outputEnergy += static_cast<double>(channelEnergy);
+            }
+            if (loudnessTap) { loudnessMatcher.pushTap(inputEnergy, outputEnergy, numOfSamples); }
+        }
+        loadMeter.markStage(outputGainStage);
     }
-    fifo.push(buffer);
+    else if (spectrum.isActive())
+    {
+        // при байпасе и тишине клиппер не работает, оба спектра совпадают и спадают вместе с сигналом
+        spectrum.push(preClipTap, buffer);
+        spectrum.push(postClipTap, buffer);
+        loadMeter.markStage(analysisStage);
+    }
+    // лимитер работает и при байпасе и тишине: задержка должна оставаться равной заявленной латентности
+    const bool limiterEnabled{ limiterParameter->load() >= 0.5f };
+    if (limiterEnabled)
+    {
+        TRACE_SCOPE("processBlock/limiter");
+        limiter.setCeilingInDb(limiterCeilingParameter->load());
+        limiter.setReleaseInMs(limiterReleaseParameter->load());
+        if (!limiterWasEnabled) { limiter.resume(); }
+        limiter.process(buffer, !gainController.getBypassState());
+    }
+    else { limiter.delay(buffer); }
+    limiterWasEnabled = limiterEnabled;
+    loadMeter.markStage(limiterStage);
 }
 
-//==============================================================================
-bool DestructionAudioProcessor::hasEditor() const
+void DestructionAudioProcessor::applyQualityProfile(const QualityProfile& profile) noexcept
 {
-    return true; // (change this to false if you choose to not supply an editor)
+    quality = profile;
+    limiter.setQuality(profile.limiterOversampling, profile.limiterInterpolationTaps);
+    clipHolder.getCustomClipper()->setAnalytic(profile.analyticCurves);
+    for (auto& stage : extraStages) { stage.clipHolder.getCustomClipper()->setAnalytic(profile.analyticCurves); }
+    modulation.setControlInterval(profile.modulationInterval);
 }
 
-juce::AudioProcessorEditor* DestructionAudioProcessor::createEditor()
+void DestructionAudioProcessor::handleMidiEvent(const juce::MidiMessage& message) noexcept
 {
-    return new DestructionAudioProcessorEditor (*this);
+    /* MIDI управляет параметрами Clip, Clipper Type и Bypass. Новое значение
+    сразу применяется к DSP с позиции события, чтобы переключение было точным
+    до сэмпла, и передаётся в параметр через timerCallback: запись параметров
+    из аудиопотока уведомляла бы слушателей синхронно. Когда параметр
+    обновится, хост, окно и сохранённое состояние совпадут со звучащим. */
+    const int numClipperTypes{ custom };
+    auto setClip = [this](double clip)
+    {
+        clipHolder.getClipper()->updateMultiplier(clip);
+        midiParameterValues[midiClip].store(static_cast<float>(clip));
+    };
+    auto selectClipper = [this](int clipperType)
+    {
+        const auto clip{ clipHolder.getClipper()->getClip() };
+        clipHolder.setClipper(clipperType);
+        clipHolder.getClipper()->updateMultiplier(clip);
+        midiParameterValues[midiClipperType].store(static_cast<float>(clipperType));
+    };
+    auto setBypass = [this](bool shouldBeBypassed)
+    {
+        gainController.setBypassState(shouldBeBypassed);
+        midiParameterValues[midiBypass].store(shouldBeBypassed ? 1.0f : 0.0f);
+    };
+    if (message.isController())
+    {
+        const auto value{ message.getControllerValue() };
+        switch (message.getControllerNumber())
+        {
+        case MIDI_CC_CLIP: setClip(juce::jmap(value / 127.0, 1.0, 10.0)); break;
+        case MIDI_CC_CLIPPER_TYPE: selectClipper(juce::jmin(numClipperTypes - 1, value * numClipperTypes / 128)); break;
+        case MIDI_CC_BYPASS: setBypass(value >= 64); break;
+        default: break;
+        }
+    }
+    else if (message.isNoteOn())
+    {
+        const auto note{ message.getNoteNumber() };
+        if (note == MIDI_NOTE_BYPASS) { setBypass(true); }
+        else if (juce::isPositiveAndBelow(note - MIDI_NOTE_FIRST_CLIPPER, numClipperTypes)) { selectClipper(note - MIDI_NOTE_FIRST_CLIPPER); }
+    }
+    else if (message.isNoteOff() && message.getNoteNumber() == MIDI_NOTE_BYPASS) { setBypass(false); }
 }
 
-void DestructionAudioProcessor::updatePluginState()
+void DestructionAudioProcessor::timerCallback()
 {
-    double newInputGainDb{ static_cast<double>(apvts.getRawParameterValue("Input Gain")->load()) };
-    double newOutputGainDb{ static_cast<double>(apvts.getRawParameterValue("Output Gain")->load()) };
-    double newClipGainDb{ static_cast<double>(apvts.getRawParameterValue("Clip")->load()) };
-    bool newBypass{ static_cast<bool>(apvts.getRawParameterValue("Bypass")->load()) };
-    bool newLink{ static_cast<bool>(apvts.getRawParameterValue("Link")->load()) };
-    int newClipperType{ static_cast<int>(apvts.getRawParameterValue("Clipper Type")->load()) };
-
-    gainController.setInputGainLevelInDb(newInputGainDb);
-    gainController.setOutputGainLevelInDb(newOutputGainDb);
-    gainController.setBypassState(newBypass);
-    clipHolder.setClipper(newClipperType);
-    clipHolder.getClipper()->updateMultiplier(newClipGainDb);
-    if (newLink)
+    // message thread: изменения от MIDI доходят до параметров и через них до хоста
+    static const std::array<const char*, numMidiTargets> parameterIds{ "Clip", "Clipper Type", "Bypass" };
+    for (size_t i = 0; i < midiParameterValues.size(); ++i)
     {
-        if (gainController.getInputGainLevelInDb() < 0)
+        const auto value{ midiParameterValues[i].exchange(-1.0f) };
+        if (value < 0.0f) { continue; }
+        if (auto* parameter = apvts.getParameter(parameterIds[i]))
+        {
+            parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+        }
+    }
+}
+
+//==============================================================================
+bool DestructionAudioProcessor::hasEditor() const
+{
+    return true; // (change this to false if you choose to not supply an editor)
+}
+
+juce::AudioProcessorEditor* DestructionAudioProcessor::createEditor()
+{
+    return new DestructionAudioProcessorEditor (*this);
+}
+
+void DestructionAudioProcessor::updatePluginState()
+{
+    /* Вызывается на message thread: снимок уходит в аудиопоток через ту же
+    очередь, что и пресеты, и применяется там целиком в начале блока. */
+    if (!presetSnapshots.push(makeParameterSnapshot())) { snapshotsOverflowed.store(true); }
+}
+
+ParameterSnapshot DestructionAudioProcessor::makeParameterSnapshot() const noexcept
+{
+    ParameterSnapshot snapshot;
+    snapshot.inputGainInDb = static_cast<double>(inputGainParameter->load());
+    snapshot.outputGainInDb = static_cast<double>(outputGainParameter->load());
+    snapshot.clip = static_cast<double>(clipParameter->load());
+    snapshot.bypassed = static_cast<bool>(bypassParameter->load());
+    snapshot.linked = static_cast<bool>(linkParameter->load());
+    snapshot.autoGain = static_cast<bool>(autoGainParameter->load());
+    snapshot.clipperType = static_cast<int>(clipperTypeParameter->load());
+    return snapshot;
+}
+
+void DestructionAudioProcessor::applyParameterSnapshot(const ParameterSnapshot& snapshot)
+{
+    gainController.setInputGainLevelInDb(snapshot.inputGainInDb);
+    gainController.setOutputGainLevelInDb(snapshot.outputGainInDb);
+    gainController.setBypassState(snapshot.bypassed);
+    clipHolder.setClipper(snapshot.clipperType);
+    clipHolder.getClipper()->updateMultiplier(snapshot.clip);
+    if (snapshot.linked && !snapshot.autoGain)
+    {
+        if (gainController.getInputGainLevelInDb() < 0)
         {
             gainController.setInputGainLevelInDb(-gainController.getOutputGainLevelInDb());
         }
@@ -368,36 +1269,50 @@ void DestructionAudioProcessor::updatePluginState()
             gainController.setOutputGainLevelInDb(-gainController.getInputGainLevelInDb());
         }
     }
-    DBG("input gain = " << gainController.getInputGainLevelInDb() << " | outputGain = " << gainController.getOutputGainLevelInDb());
 }
 
 //==============================================================================
 void DestructionAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // Метод 1 - Запись в стрим
-    /*
+    /* Компактный бинарный формат: заголовок, версия формата, имя пресета,
+    версия плагина и пары (CRC-32 идентификатора, значение) для каждого параметра.
+    В отличие от XML, при загрузке проекта не требует разбора текста. */
+    TRACE_SCOPE("getStateInformation");
+    if (!apvts.state.isValid()) { return; }
     juce::MemoryOutputStream mos{ destData, false };
-    if (apvts.state.isValid()) { apvts.state.writeToStream(mos); }
-    */
-
-    // Метод 2 - Запись xml в бинарник
-    if (apvts.state.isValid())
+    mos.writeInt(STATE_MAGIC);
+    mos.writeInt(STATE_FORMAT_VERSION);
+    mos.writeString(apvts.state.getProperty(juce::Identifier("presetName")).toString());
+    mos.writeString(apvts.state.getProperty(juce::Identifier("version")).toString());
+    const auto& parameters{ getParameters() };
+    mos.writeCompressedInt(parameters.size());
+    for (auto* parameter : parameters)
     {
-        const auto xml{ apvts.copyState().createXml() };
-        copyXmlToBinary(*xml, destData);
+        // все параметры APVTS являются RangedAudioParameter
+        const auto* ranged{ static_cast<juce::RangedAudioParameter*>(parameter) };
+        mos.writeInt(static_cast<int>(getStateParameterKey(ranged->paramID)));
+        mos.writeFloat(ranged->convertFrom0to1(ranged->getValue()));
+    }
+    const auto curve{ getCustomCurve() };
+    mos.writeCompressedInt(static_cast<int>(curve.getPoints().size()));
+    for (const auto& point : curve.getPoints())
+    {
+        mos.writeFloat(point.x);
+        mos.writeFloat(point.y);
     }
 }
 
 void DestructionAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // Метод 1 - Чтение из стрима или напрямую из данных
-    /*
-    juce::ValueTree tempTree{ juce::ValueTree::readFromData(data, static_cast<size_t>(sizeInBytes)) };
-    if (tempTree.isValid() && tempTree == apvts.state) { apvts.replaceState(tempTree); }
-    else { jassertfalse; }
-    */
-
-    // Метод 2 - Чтение из бинарника в xml
+    TRACE_SCOPE("setStateInformation");
+    for (auto& value : midiParameterValues) { value.store(-1.0f); } // MIDI до загрузки не перезаписывает состояние хоста
+    juce::MemoryInputStream mis{ data, static_cast<size_t>(sizeInBytes), false };
+    if (sizeInBytes >= 8 && mis.readInt() == STATE_MAGIC)
+    {
+        if (readBinaryState(mis)) { updatePluginState(); }
+        return;
+    }
+    // Устаревший формат - чтение из бинарника в xml
     const auto xml{ getXmlFromBinary(data, sizeInBytes) };
     if (xml != nullptr) // проверка обязательна, иначе вылезает jassert
     {
@@ -409,6 +1324,1050 @@ void DestructionAudioProcessor::setStateInformation (const void* data, int sizeI
         }
     }
 }
+
+void DestructionAudioProcessor::getLegacyStateInformation(juce::MemoryBlock& destData)
+{
+    // Устаревший формат - запись xml в бинарник, читается всеми версиями плагина
+    if (apvts.state.isValid())
+    {
+        const auto xml{ apvts.copyState().createXml() };
+        copyXmlToBinary(*xml, destData);
+    }
+}
+
+bool DestructionAudioProcessor::readBinaryState(juce::InputStream& stream)
+{
+    const int formatVersion{ stream.readInt() };
+    if (formatVersion < 1 || formatVersion > STATE_FORMAT_VERSION)
+    {
+        DBG("Unsupported plugin state format version");
+        jassertfalse;
+        return false;
+    }
+    /* Дерево собирается из копии дефолтного, поэтому параметры, отсутствующие
+    в сохранённом состоянии, получают значения по умолчанию, а неизвестные
+    идентификаторы (из более новых версий) пропускаются. */
+    juce::ValueTree tempTree{ defaultTree.createCopy() };
+    tempTree.setProperty(juce::Identifier("presetName"), stream.readString(), nullptr);
+    tempTree.setProperty(juce::Identifier("version"), stream.readString(), nullptr);
+    const int numParameters{ stream.readCompressedInt() };
+    for (int i = 0; i < numParameters && !stream.isExhausted(); ++i)
+    {
+        const int key{ stream.readInt() };
+        const float value{ stream.readFloat() };
+        for (auto child : tempTree)
+        {
+            // версии 1 и 2 хранили String::hashCode идентификатора
+            const auto id{ child.getProperty(juce::Identifier("id")).toString() };
+            if ((formatVersion >= 3 ? static_cast<int>(getStateParameterKey(id)) : id.hashCode()) == key)
+            {
+                child.setProperty(juce::Identifier("value"), value, nullptr);
+                break;
+            }
+        }
+    }
+    if (formatVersion >= 2 && !stream.isExhausted())
+    {
+        std::vector<juce::Point<float>> points;
+        const int numPoints{ stream.readCompressedInt() };
+        for (int i = 0; i < numPoints && !stream.isExhausted(); ++i)
+        {
+            const float x{ stream.readFloat() };
+            points.push_back({ x, stream.readFloat() });
+        }
+        if (points.size() >= 2)
+        {
+            TransferCurve curve;
+            curve.setPoints(points);
+            tempTree.getChildWithName(TransferCurve::curveId).copyPropertiesAndChildrenFrom(curve.toValueTree(), nullptr);
+        }
+    }
+    apvts.replaceState(tempTree);
+    return true;
+}
+
+TransferCurve DestructionAudioProcessor::getCustomCurve() const
+{
+    return TransferCurve::fromValueTree(apvts.state.getChildWithName(TransferCurve::curveId));
+}
+
+void DestructionAudioProcessor::setCustomCurve(const TransferCurve& curve)
+{
+    auto curveTree{ apvts.state.getChildWithName(TransferCurve::curveId) };
+    if (curveTree.isValid()) { curveTree.copyPropertiesAndChildrenFrom(curve.toValueTree(), nullptr); }
+    else { apvts.state.appendChild(curve.toValueTree(), nullptr); }
+    compileCustomCurve();
+}
+
+void DestructionAudioProcessor::compileCustomCurve()
+{
+    /* Таблица строится в фоновом потоке и публикуется через TripleBuffer,
+    аудиопоток подхватывает её в начале следующего блока. Перетаскивание
+    точки присылает кривую на каждое движение мыши, поэтому в очереди
+    держится не больше одной задачи: она берёт самую свежую кривую. */
+    const auto curve{ getCustomCurve() };
+    harmonicAnalysis.setCustomCurve(curve);
+    const juce::ScopedLock scopedLock{ curveLock };
+    const bool jobQueued{ pendingCurve != nullptr };
+    pendingCurve = std::make_unique<TransferCurve>(curve);
+    if (jobQueued) { return; }
+    curveCompiler.addJob([this]()
+        {
+            TRACE_SCOPE("compileCustomCurve");
+            std::unique_ptr<TransferCurve> latestCurve;
+            {
+                const juce::ScopedLock jobLock{ curveLock };
+                latestCurve = std::move(pendingCurve);
+            }
+            if (latestCurve == nullptr) { return; }
+            latestCurve->compile(curveTables.getWriteBuffer());
+            curveTables.publish();
+        });
+}
+
+void DestructionAudioProcessor::valueTreeRedirected(juce::ValueTree&)
+{
+    compileCustomCurve(); // пресет или состояние хоста заменили дерево вместе с кривой
+}
+LoadStatistics DestructionAudioProcessor::getLoadStatistics() const
+{
+    auto statistics{ loadMeter.getStatistics() };
+    statistics.qualityLevel = governor.getLevel();
+    return statistics;
+}
+
+void DestructionAudioProcessor::resetLoadStatistics() { loadMeter.requestReset(); }
+//==============================================================================
+QualityProfile QualityProfile::realtime() noexcept { return {}; }
+
+QualityProfile QualityProfile::offline() noexcept
+{
+    QualityProfile profile;
+    profile.limiterOversampling = TruePeakLimiter::maxOversampling;
+    profile.limiterInterpolationTaps = TruePeakLimiter::maxInterpolationTaps;
+    profile.analyticCurves = true;
+    profile.modulationInterval = 1;
+    profile.minSubBlockSize = 1;
+    profile.isOffline = true;
+    return profile;
+}
+//==============================================================================
+void QualityGovernor::prepare(double newSampleRate)
+{
+    sampleRate = newSampleRate;
+    reset();
+}
+
+void QualityGovernor::reset() noexcept
+{
+    averageLoad = 0.0;
+    level.store(0, std::memory_order_relaxed);
+    holdSamples = 0;
+    recoverySamples = 0;
+}
+
+bool QualityGovernor::update(double load, int numSamples) noexcept
+{
+    averageLoad += smoothing * (load - averageLoad);
+    holdSamples = juce::jmax(0, holdSamples - numSamples);
+    // счётчик упирается в порог: на нулевой ступени под малой нагрузкой он иначе переполнился бы за часы
+    const int recoveryThreshold{ static_cast<int>(sampleRate * GOVERNOR_RECOVERY_MS * 0.001) };
+    recoverySamples = averageLoad < GOVERNOR_LOW_LOAD ? juce::jmin(recoveryThreshold, recoverySamples + numSamples) : 0;
+    const int current{ level.load(std::memory_order_relaxed) };
+    int next{ current };
+    if (load >= 1.0 || (holdSamples == 0 && averageLoad > GOVERNOR_HIGH_LOAD)) { next = juce::jmin(current + 1, numLevels - 1); }
+    else if (holdSamples == 0 && recoverySamples >= recoveryThreshold)
+    {
+        next = juce::jmax(current - 1, 0);
+    }
+    if (next == current) { return false; }
+    level.store(next, std::memory_order_relaxed);
+    holdSamples = static_cast<int>(sampleRate * GOVERNOR_HOLD_MS * 0.001);
+    recoverySamples = 0;
+    return true;
+}
+
+int QualityGovernor::getLevel() const noexcept { return level.load(std::memory_order_relaxed); }
+
+QualityProfile QualityGovernor::getProfile(int qualityLevel) noexcept
+{
+    /* Первым делом дешевеет детектор пиков лимитера и управляющий сигнал
+    модуляции, затем укорачивается ядро интерполяции и реже кормится анализ.
+    Звук клиппера не меняется ни на одной ступени. */
+    auto profile{ QualityProfile::realtime() };
+    if (qualityLevel >= 1)
+    {
+        profile.limiterOversampling = 2;
+        profile.modulationInterval = 2 * MOD_CONTROL_INTERVAL;
+        profile.analysisInterval = 2;
+    }
+    if (qualityLevel >= 2)
+    {
+        profile.limiterInterpolationTaps = 4;
+        profile.modulationInterval = 4 * MOD_CONTROL_INTERVAL;
+        profile.analysisInterval = 4;
+    }
+    return profile;
+}
+//==============================================================================
+void LoudnessMatcher::prepare(double newSampleRate)
+{
+    sampleRate = newSampleRate;
+    resetRequested = true;
+}
+
+void LoudnessMatcher::pushTap(double inputEnergy, double outputEnergy, int numSamples) noexcept
+{
+    taps.push({ inputEnergy, outputEnergy, numSamples }); // при переполнении блок просто не учитывается
+}
+
+float LoudnessMatcher::getCompensationInDb() const noexcept { return compensationInDb.load(std::memory_order_relaxed); }
+
+int LoudnessMatcher::useTimeSlice()
+{
+    TRACE_SCOPE("LoudnessMatcher::useTimeSlice");
+    // после prepareToPlay интеграл начинается заново, а опубликованная компенсация сохраняется
+    if (resetRequested.exchange(false))
+    {
+        inputIntegral = 0.0;
+        outputIntegral = 0.0;
+    }
+    LoudnessTap tap;
+    bool updated{ false };
+    while (taps.pull(tap))
+    {
+        if (tap.numSamples <= 0 || tap.outputEnergy / tap.numSamples < gateEnergy) { continue; }
+        const double decay{ std::exp(-tap.numSamples / (integrationSeconds * sampleRate.load())) };
+        inputIntegral = decay * inputIntegral + tap.inputEnergy;
+        outputIntegral = decay * outputIntegral + tap.outputEnergy;
+        updated = true;
+    }
+    if (updated && inputIntegral > 0.0 && outputIntegral > 0.0)
+    {
+        const auto compensation{ static_cast<float>(10.0 * std::log10(inputIntegral / outputIntegral)) };
+        compensationInDb = juce::jlimit(-maxCompensationInDb, maxCompensationInDb, compensation);
+    }
+    return 50;
+}
+//==============================================================================
+SpectrumAnalyzer::SpectrumAnalyzer()
+{
+    for (auto& channel : channels)
+    {
+        channel.ring.assign(static_cast<size_t>(ringSize), 0.0f);
+        channel.frame.assign(static_cast<size_t>(fftSize), 0.0f);
+        for (auto& level : channel.levels) { level.store(minLevelInDb, std::memory_order_relaxed); }
+        for (auto& peak : channel.peaks) { peak.store(minLevelInDb, std::memory_order_relaxed); }
+    }
+    window.resize(static_cast<size_t>(fftSize));
+    juce::dsp::WindowingFunction<float>::fillWindowingTables(window.data(), window.size(),
+                                                             juce::dsp::WindowingFunction<float>::hann, false);
+    fftData.assign(static_cast<size_t>(2 * fftSize), 0.0f);
+}
+
+void SpectrumAnalyzer::prepare(double newSampleRate)
+{
+    sampleRate = newSampleRate;
+    resetRequested = true;
+}
+
+void SpectrumAnalyzer::setActive(bool shouldBeActive) noexcept
+{
+    if (shouldBeActive && !active.load()) { resetRequested = true; } // старые отсчёты из кольца не показываются
+    active = shouldBeActive;
+}
+
+bool SpectrumAnalyzer::isActive() const noexcept { return active.load(std::memory_order_relaxed); }
+
+void SpectrumAnalyzer::push(int tap, const juce::AudioBuffer<float>& buffer) noexcept
+{
+    const int numSamples{ buffer.getNumSamples() };
+    const int numChannels{ buffer.getNumChannels() };
+    auto& channel{ channels[static_cast<size_t>(tap)] };
+    // при отставании фонового потока блок отбрасывается целиком, без разрывов внутри окна
+    if (numChannels == 0 || channel.fifo.getFreeSpace() < numSamples) { return; }
+    const auto scale{ 1.0f / static_cast<float>(numChannels) };
+    const auto scope{ channel.fifo.write(numSamples) };
+    auto downmix = [&](int ringStart, int sourceStart, int count)
+    {
+        if (count <= 0) { return; }
+        auto* destination{ channel.ring.data() + ringStart };
+        juce::FloatVectorOperations::copyWithMultiply(destination, buffer.getReadPointer(0, sourceStart), scale, count);
+        for (int i = 1; i < numChannels; ++i)
+        {
+            juce::FloatVectorOperations::addWithMultiply(destination, buffer.getReadPointer(i, sourceStart), scale, count);
+        }
+    };
+    downmix(scope.startIndex1, 0, scope.blockSize1);
+    downmix(scope.startIndex2, scope.blockSize1, scope.blockSize2);
+}
+
+void SpectrumAnalyzer::getSpectrum(int tap, Spectrum& levels, Spectrum& peaks) const noexcept
+{
+    const auto& channel{ channels[static_cast<size_t>(tap)] };
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        levels[i] = channel.levels[i].load(std::memory_order_relaxed);
+        peaks[i] = channel.peaks[i].load(std::memory_order_relaxed);
+    }
+}
+
+juce::uint32 SpectrumAnalyzer::getVersion() const noexcept { return version.load(std::memory_order_acquire); }
+
+float SpectrumAnalyzer::getMaxFrequency() const noexcept { return juce::jmin(20000.0f, static_cast<float>(0.5 * sampleRate.load())); }
+
+int SpectrumAnalyzer::useTimeSlice()
+{
+    TRACE_SCOPE("SpectrumAnalyzer::useTimeSlice");
+    if (resetRequested.exchange(false)) { reset(); }
+    bool updated{ false };
+    for (auto& channel : channels)
+    {
+        while (channel.fifo.getNumReady() >= hopSize)
+        {
+            // окно сдвигается на шаг, новые отсчёты дописываются в конец
+            std::copy(channel.frame.begin() + hopSize, channel.frame.end(), channel.frame.begin());
+            const auto scope{ channel.fifo.read(hopSize) };
+            auto* destination{ channel.frame.data() + fftSize - hopSize };
+            std::copy_n(channel.ring.data() + scope.startIndex1, scope.blockSize1, destination);
+            std::copy_n(channel.ring.data() + scope.startIndex2, scope.blockSize2, destination + scope.blockSize1);
+            analyse(channel);
+            updated = true;
+        }
+    }
+    if (updated) { version.fetch_add(1, std::memory_order_release); }
+    return updated ? 10 : 30;
+}
+
+void SpectrumAnalyzer::reset()
+{
+    const auto rate{ sampleRate.load() };
+    const auto maxFrequency{ getMaxFrequency() };
+    for (size_t i = 0; i < binEdges.size(); ++i)
+    {
+        const auto proportion{ static_cast<float>(i) / SPECTRUM_NUM_BINS };
+        const auto frequency{ minFrequency * std::pow(maxFrequency / minFrequency, proportion) };
+        binEdges[i] = static_cast<float>(frequency * fftSize / rate);
+    }
+    const double frameSeconds{ hopSize / rate };
+    attack = static_cast<float>(1.0 - std::exp(-frameSeconds / attackSeconds));
+    release = static_cast<float>(1.0 - std::exp(-frameSeconds / releaseSeconds));
+    peakHoldFrames = static_cast<int>(SPECTRUM_PEAK_HOLD_MS * 0.001 / frameSeconds);
+    peakFall = static_cast<float>(peakFallInDbPerSecond * frameSeconds);
+    for (auto& channel : channels)
+    {
+        channel.fifo.read(channel.fifo.getNumReady()); // читать кольцо может только фоновый поток, поэтому оно просто вычитывается
+        std::fill(channel.frame.begin(), channel.frame.end(), 0.0f);
+        channel.smoothed.fill(minLevelInDb);
+        channel.held.fill(minLevelInDb);
+        channel.holdFrames.fill(0);
+    }
+}
+
+void SpectrumAnalyzer::analyse(Channel& channel) noexcept
+{
+    juce::FloatVectorOperations::multiply(fftData.data(), channel.frame.data(), window.data(), fftSize);
+    std::fill(fftData.begin() + fftSize, fftData.end(), 0.0f);
+    fft.performFrequencyOnlyForwardTransform(fftData.data());
+    // синус полной шкалы с окном Ханна даёт в своём бине fftSize / 4
+    const float scale{ 4.0f / fftSize };
+    const int lastIndex{ fftSize / 2 };
+    for (int bin = 0; bin < SPECTRUM_NUM_BINS; ++bin)
+    {
+        const auto from{ binEdges[static_cast<size_t>(bin)] };
+        const auto to{ binEdges[static_cast<size_t>(bin + 1)] };
+        float magnitude{ 0.0f };
+        const auto first{ static_cast<int>(std::ceil(from)) };
+        const auto last{ juce::jmin(lastIndex, static_cast<int>(std::floor(to))) };
+        if (first <= last)
+        {
+            // широкая полоса - максимум по её бинам, чтобы гармоники не усреднялись
+            for (int index = first; index <= last; ++index) { magnitude = juce::jmax(magnitude, fftData[static_cast<size_t>(index)]); }
+        }
+        else
+        {
+            // на низах полоса уже бина FFT - линейная интерполяция по центру полосы
+            const auto centre{ juce::jmin(static_cast<float>(lastIndex - 1), 0.5f * (from + to)) };
+            const auto index{ static_cast<int>(centre) };
+            const auto fraction{ centre - static_cast<float>(index) };
+            magnitude = fftData[static_cast<size_t>(index)]
+                        + fraction * (fftData[static_cast<size_t>(index + 1)] - fftData[static_cast<size_t>(index)]);
+        }
+        const auto level{ juce::Decibels::gainToDecibels(magnitude * scale, minLevelInDb) };
+        auto& smoothed{ channel.smoothed[static_cast<size_t>(bin)] };
+        smoothed += (level > smoothed ? attack : release) * (level - smoothed);
+        auto& held{ channel.held[static_cast<size_t>(bin)] };
+        auto& holdFrames{ channel.holdFrames[static_cast<size_t>(bin)] };
+        if (smoothed >= held)
+        {
+            held = smoothed;
+            holdFrames = peakHoldFrames;
+        }
+        else if (holdFrames > 0) { --holdFrames; }
+        else { held = juce::jmax(smoothed, held - peakFall); }
+        channel.levels[static_cast<size_t>(bin)].store(smoothed, std::memory_order_relaxed);
+        channel.peaks[static_cast<size_t>(bin)].store(held, std::memory_order_relaxed);
+    }
+}
+//==============================================================================
+HarmonicReport HarmonicAnalyzer::analyse(int clipperType, double clip, const CurveTable* customTable)
+{
+    HarmonicReport report;
+    report.clipperType = clipperType;
+    report.clip = clip;
+    clipHolder.getCustomClipper()->setTable(customTable);
+    auto* clipper{ clipHolder.getClipper(clipperType) };
+    clipper->updateMultiplier(clip);
+    data.assign(static_cast<size_t>(2 * fftSize), 0.0f);
+    for (int i = 0; i < fftSize; ++i)
+    {
+        // фаза считается по модулю периода в целых числах, без накопления ошибки
+        const auto phase{ static_cast<double>((static_cast<juce::int64>(HARMONIC_TEST_BIN) * i) % fftSize) / fftSize };
+        data[static_cast<size_t>(i)] = static_cast<float>(HARMONIC_TEST_AMPLITUDE * std::sin(juce::MathConstants<double>::twoPi * phase));
+    }
+    clipper->processBlock(data.data(), fftSize);
+    fft.performFrequencyOnlyForwardTransform(data.data());
+    // синус с амплитудой A на своём бине даёт A * fftSize / 2
+    auto getPower = [this](int bin)
+    {
+        const double amplitude{ 2.0 * data[static_cast<size_t>(bin)] / fftSize };
+        return amplitude * amplitude;
+    };
+    auto toDecibels = [](double powerRatio) { return juce::Decibels::gainToDecibels(std::sqrt(powerRatio), -200.0); };
+    const double fundamental{ juce::jmax(1.0e-20, getPower(HARMONIC_TEST_BIN)) };
+    double harmonicPower{ 0.0 };
+    double aliasPower{ 0.0 };
+    for (int bin = 1; bin <= fftSize / 2; ++bin)
+    {
+        if (bin % HARMONIC_TEST_BIN != 0)
+        {
+            aliasPower += getPower(bin);
+            continue;
+        }
+        const int order{ bin / HARMONIC_TEST_BIN };
+        if (order < 2 || order > HARMONIC_MAX_ORDER) { continue; }
+        harmonicPower += getPower(bin);
+        report.harmonicsInDb[static_cast<size_t>(order - 2)] = toDecibels(getPower(bin) / fundamental);
+    }
+    report.fundamentalInDb = toDecibels(fundamental);
+    report.thd = std::sqrt(harmonicPower / fundamental);
+    report.aliasInDb = toDecibels(aliasPower / fundamental);
+    return report;
+}
+
+double HarmonicAnalyzer::getMultiplierFor(int clipperType, double clip) const
+{
+    return clipHolder.getClipper(clipperType)->getMultiplierFor(clip);
+}
+
+double HarmonicAnalyzer::getTestFrequency() noexcept { return HARMONIC_TEST_BIN * HARMONIC_SAMPLE_RATE / fftSize; }
+//==============================================================================
+void HarmonicAnalysisService::request(int clipperType, double clip)
+{
+    const juce::ScopedLock scopedLock{ lock };
+    if (cache.find(makeKey(clipperType, clip)) != cache.end()) { return; }
+    // нужен только последний запрос интерфейса, промежуточные положения ручки не считаются
+    pending.assign(1, { clipperType, clip });
+}
+
+bool HarmonicAnalysisService::getReport(int clipperType, double clip, HarmonicReport& report) const
+{
+    const juce::ScopedLock scopedLock{ lock };
+    const auto entry{ cache.find(makeKey(clipperType, clip)) };
+    if (entry == cache.end()) { return false; }
+    report = entry->second;
+    return true;
+}
+
+void HarmonicAnalysisService::setCustomCurve(const TransferCurve& curve)
+{
+    const juce::ScopedLock scopedLock{ lock };
+    pendingCurve = std::make_unique<TransferCurve>(curve);
+    for (auto entry = cache.begin(); entry != cache.end();)
+    {
+        entry = entry->first.first == custom - 1 ? cache.erase(entry) : std::next(entry);
+    }
+    ++generation;
+}
+
+juce::uint32 HarmonicAnalysisService::getGeneration() const noexcept { return generation.load(); }
+
+HarmonicAnalysisService::Key HarmonicAnalysisService::makeKey(int clipperType, double clip) const
+{
+    return { clipperType, static_cast<juce::int64>(std::llround(analyzer.getMultiplierFor(clipperType, clip) * 1.0e4)) };
+}
+
+int HarmonicAnalysisService::useTimeSlice()
+{
+    std::unique_ptr<TransferCurve> curve;
+    std::vector<std::pair<int, double>> requests;
+    juce::uint32 startGeneration;
+    {
+        const juce::ScopedLock scopedLock{ lock };
+        curve = std::move(pendingCurve);
+        requests.swap(pending);
+        startGeneration = generation.load();
+    }
+    if (curve != nullptr)
+    {
+        curve->compile(customTable);
+        hasCustomTable = true;
+    }
+    if (requests.empty()) { return 50; }
+    TRACE_SCOPE("HarmonicAnalysisService::useTimeSlice");
+    for (const auto& [clipperType, clip] : requests)
+    {
+        const auto report{ analyzer.analyse(clipperType, clip, hasCustomTable ? &customTable : nullptr) };
+        const juce::ScopedLock scopedLock{ lock };
+        // кривая сменилась во время расчёта - результат Custom устарел
+        if (clipperType == custom - 1 && generation.load() != startGeneration) { continue; }
+        if (cache.size() >= maxCacheSize) { cache.clear(); }
+        cache[makeKey(clipperType, clip)] = report;
+    }
+    return 10;
+}
+//==============================================================================
+void DryDelay::prepare(int numChannels, int maxBlockSize, int maxDelay)
+{
+    delayLine.setSize(numChannels, maxDelay + 1);
+    dryBuffer.setSize(numChannels, maxBlockSize);
+    delay = juce::jmin(delay, maxDelay);
+    reset();
+}
+
+void DryDelay::reset()
+{
+    delayLine.clear();
+    writePosition = 0;
+}
+
+void DryDelay::setDelay(int newDelay) noexcept
+{
+    newDelay = juce::jlimit(0, delayLine.getNumSamples() - 1, newDelay);
+    if (newDelay == delay) { return; }
+    delay = newDelay;
+    reset();
+}
+
+int DryDelay::getDelay() const noexcept { return delay; }
+
+void DryDelay::capture(const juce::AudioBuffer<float>& input) noexcept
+{
+    const auto numChannels{ juce::jmin(input.getNumChannels(), dryBuffer.getNumChannels()) };
+    const auto numSamples{ juce::jmin(input.getNumSamples(), dryBuffer.getNumSamples()) };
+    if (delay == 0)
+    {
+        for (int channel = 0; channel < numChannels; ++channel) { dryBuffer.copyFrom(channel, 0, input, channel, 0, numSamples); }
+        return;
+    }
+    const auto length{ delayLine.getNumSamples() };
+    auto position{ writePosition };
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        const auto* source{ input.getReadPointer(channel) };
+        auto* line{ delayLine.getWritePointer(channel) };
+        auto* destination{ dryBuffer.getWritePointer(channel) };
+        position = writePosition;
+        for (int i = 0; i < numSamples; ++i)
+        {
+            line[position] = source[i];
+            auto readPosition{ position - delay };
+            if (readPosition < 0) { readPosition += length; }
+            destination[i] = line[readPosition];
+            if (++position == length) { position = 0; }
+        }
+    }
+    writePosition = position;
+}
+
+const float* DryDelay::getReadPointer(int channel) const noexcept
+{
+    return dryBuffer.getReadPointer(juce::jmin(channel, dryBuffer.getNumChannels() - 1));
+}
+//==============================================================================
+void EnvelopeFollower::prepare(double newSampleRate)
+{
+    sampleRate = newSampleRate;
+    attackCoefficient = getCoefficient(attackInMs);
+    releaseCoefficient = getCoefficient(releaseInMs);
+    reset();
+}
+
+void EnvelopeFollower::reset() { state = 0.0f; }
+
+void EnvelopeFollower::setAttackInMs(float newAttackInMs) noexcept
+{
+    if (newAttackInMs == attackInMs) { return; }
+    attackInMs = newAttackInMs;
+    attackCoefficient = getCoefficient(attackInMs);
+}
+
+void EnvelopeFollower::setReleaseInMs(float newReleaseInMs) noexcept
+{
+    if (newReleaseInMs == releaseInMs) { return; }
+    releaseInMs = newReleaseInMs;
+    releaseCoefficient = getCoefficient(releaseInMs);
+}
+
+void EnvelopeFollower::process(const juce::AudioBuffer<float>& sidechain, float* envelope, int numSamples) noexcept
+{
+    if (sidechain.getNumChannels() == 0)
+    {
+        juce::FloatVectorOperations::clear(envelope, numSamples);
+        return;
+    }
+    juce::FloatVectorOperations::abs(envelope, sidechain.getReadPointer(0), numSamples);
+    for (int channel = 1; channel < sidechain.getNumChannels(); ++channel)
+    {
+        const auto* data{ sidechain.getReadPointer(channel) };
+        for (int i = 0; i < numSamples; ++i) { envelope[i] = juce::jmax(envelope[i], std::abs(data[i])); }
+    }
+    const auto attack{ attackCoefficient }, release{ releaseCoefficient };
+    auto current{ state };
+    for (int i = 0; i < numSamples; ++i)
+    {
+        const auto input{ envelope[i] };
+        const auto coefficient{ input > current ? attack : release }; // выбор без перехода
+        current += coefficient * (input - current);
+        envelope[i] = current;
+    }
+    state = current;
+}
+
+float EnvelopeFollower::getCoefficient(float timeInMs) const noexcept
+{
+    return 1.0f - std::exp(-1.0f / (0.001f * juce::jmax(0.01f, timeInMs) * static_cast<float>(sampleRate)));
+}
+//==============================================================================
+void TransientDetector::prepare(double newSampleRate)
+{
+    sampleRate = newSampleRate;
+    fast = makeCoefficients(TRANSIENT_FAST_ATTACK_MS, TRANSIENT_FAST_RELEASE_MS);
+    slow = makeCoefficients(TRANSIENT_SLOW_ATTACK_MS, TRANSIENT_SLOW_RELEASE_MS);
+    reset();
+}
+
+void TransientDetector::reset()
+{
+    fastState = 0.0f;
+    slowState = 0.0f;
+}
+
+void TransientDetector::process(const juce::AudioBuffer<float>& buffer, float* weights, int numSamples) noexcept
+{
+    // связанное по каналам обнаружение: одинаковый вес на все каналы сохраняет стереообраз
+    juce::FloatVectorOperations::abs(weights, buffer.getReadPointer(0), numSamples);
+    for (int channel = 1; channel < buffer.getNumChannels(); ++channel)
+    {
+        const auto* data{ buffer.getReadPointer(channel) };
+        for (int i = 0; i < numSamples; ++i) { weights[i] = juce::jmax(weights[i], std::abs(data[i])); }
+    }
+    const auto fastCoefficients{ fast }, slowCoefficients{ slow };
+    auto fastEnvelope{ fastState }, slowEnvelope{ slowState };
+    for (int i = 0; i < numSamples; ++i)
+    {
+        const auto input{ weights[i] };
+        fastEnvelope += (input > fastEnvelope ? fastCoefficients.attack : fastCoefficients.release) * (input - fastEnvelope);
+        slowEnvelope += (input > slowEnvelope ? slowCoefficients.attack : slowCoefficients.release) * (input - slowEnvelope);
+        const auto difference{ 2.0f * (fastEnvelope - slowEnvelope) / (fastEnvelope + 1.0e-9f) };
+        weights[i] = juce::jlimit(0.0f, 1.0f, difference);
+    }
+    fastState = fastEnvelope;
+    slowState = slowEnvelope;
+}
+
+TransientDetector::Coefficients TransientDetector::makeCoefficients(float attackInMs, float releaseInMs) const noexcept
+{
+    auto toCoefficient = [this](float timeInMs) { return 1.0f - std::exp(-1.0f / (0.001f * timeInMs * static_cast<float>(sampleRate))); };
+    return { toCoefficient(attackInMs), toCoefficient(releaseInMs) };
+}
+//==============================================================================
+const juce::StringArray ModulationEngine::targetNames{ "Off", "Clip", "Input Gain", "Mix" };
+const juce::StringArray ModulationEngine::shapeNames{ "Sine", "Triangle", "Saw", "Square", "Steps" };
+const juce::StringArray ModulationEngine::rateNames{ "1/1", "1/2", "1/4", "1/8", "1/16", "1/32", "1/4T", "1/8T", "1/16T", "1/4D", "1/8D" };
+
+void ModulationEngine::prepare(double newSampleRate, int maxBlockSize)
+{
+    sampleRate = newSampleRate;
+    maxNumSamples = maxBlockSize;
+    controlValues.assign(static_cast<size_t>(maxBlockSize + 2), 0.0f);
+    reset();
+}
+
+void ModulationEngine::reset()
+{
+    std::fill(controlValues.begin(), controlValues.end(), 0.0f);
+    freeRunningPpq = 0.0;
+}
+
+void ModulationEngine::setShape(int newShape) noexcept { shape = juce::jlimit(0, static_cast<int>(steps), newShape); }
+
+void ModulationEngine::setRate(int newRate) noexcept { rate = juce::jlimit(0, rateNames.size() - 1, newRate); }
+
+void ModulationEngine::setDepth(float newDepth) noexcept { depth = juce::jlimit(0.0f, 1.0f, newDepth); }
+
+void ModulationEngine::setStep(int step, float value) noexcept
+{
+    if (juce::isPositiveAndBelow(step, MOD_NUM_STEPS)) { stepValues[static_cast<size_t>(step)] = value; }
+}
+
+void ModulationEngine::setControlInterval(int newControlInterval) noexcept { controlInterval = juce::jmax(1, newControlInterval); }
+
+void ModulationEngine::generate(juce::AudioPlayHead* playHead, int startSample, int numSamples) noexcept
+{
+    static constexpr std::array<double, 11> beatsPerCycle{ 4.0, 2.0, 1.0, 0.5, 0.25, 0.125,
+                                                           2.0 / 3.0, 1.0 / 3.0, 1.0 / 6.0, 1.5, 0.75 };
+    jassert(numSamples <= maxNumSamples);
+    double ppq{ freeRunningPpq };
+    bool playing{ false };
+    juce::AudioPlayHead::CurrentPositionInfo position;
+    if (playHead != nullptr && playHead->getCurrentPosition(position))
+    {
+        if (position.bpm > 0.0) { bpm = position.bpm; }
+        playing = position.isPlaying;
+    }
+    const double beatsPerSample{ bpm / (60.0 * sampleRate) };
+    // позиция хоста относится к началу блока, кусок начинается startSample сэмплами позже
+    if (playing) { ppq = position.ppqPosition + startSample * beatsPerSample; }
+    const double cyclesPerPoint{ beatsPerSample * controlInterval / beatsPerCycle[static_cast<size_t>(rate)] };
+    const double startCycles{ ppq / beatsPerCycle[static_cast<size_t>(rate)] };
+    const auto numPoints{ juce::jmin(static_cast<int>(controlValues.size()), numSamples / controlInterval + 2) };
+    for (int i = 0; i < numPoints; ++i)
+    {
+        controlValues[static_cast<size_t>(i)] = depth * getShapeValue(startCycles + i * cyclesPerPoint);
+    }
+    freeRunningPpq = ppq + numSamples * beatsPerSample;
+}
+
+float ModulationEngine::getShapeValue(double cycles) const noexcept
+{
+    const auto phase{ static_cast<float>(cycles - std::floor(cycles)) };
+    switch (shape)
+    {
+    case triangle: return 1.0f - 4.0f * std::abs(phase - 0.5f);
+    case saw: return 2.0f * phase - 1.0f;
+    case square: return phase < 0.5f ? 1.0f : -1.0f;
+    case steps:
+    {
+        // один цикл - один шаг, значения шагов от 0 до 1 переводятся в ±1
+        const auto step{ static_cast<juce::int64>(std::floor(cycles)) % MOD_NUM_STEPS };
+        return 2.0f * stepValues[static_cast<size_t>(step < 0 ? step + MOD_NUM_STEPS : step)] - 1.0f;
+    }
+    default: return std::sin(juce::MathConstants<float>::twoPi * phase);
+    }
+}
+//==============================================================================
+void EmphasisFilter::prepare(double newSampleRate, int numChannels, int maxBlockSize)
+{
+    sampleRate = newSampleRate;
+    preStates.assign(static_cast<size_t>(numChannels), {});
+    postStates.assign(static_cast<size_t>(numChannels), {});
+    const auto maxCoefficients{ static_cast<size_t>(juce::jmax(1, maxBlockSize) / EMPHASIS_UPDATE_INTERVAL + 1) };
+    pre.assign(maxCoefficients, {});
+    post.assign(maxCoefficients, {});
+    // после повторной подготовки фильтр продолжает с последнего наклона без рампы
+    tilt.reset(sampleRate, 0.05);
+    tilt.setCurrentAndTargetValue(tilt.getTargetValue());
+    frequency.reset(sampleRate, 0.05);
+    frequency.setCurrentAndTargetValue(frequency.getTargetValue());
+    updateCoefficients(0, tilt.getCurrentValue(), frequency.getCurrentValue());
+    numCoefficients = 1;
+    ramping = false;
+}
+
+void EmphasisFilter::reset()
+{
+    for (auto& state : preStates) { state.fill(0.0f); }
+    for (auto& state : postStates) { state.fill(0.0f); }
+}
+
+void EmphasisFilter::setTilt(float newTiltInDb, float newFrequency, int numSamples) noexcept
+{
+    tilt.setTargetValue(juce::jlimit(-EMPHASIS_MAX_DB, EMPHASIS_MAX_DB, newTiltInDb));
+    frequency.setTargetValue(newFrequency);
+    if (!tilt.isSmoothing() && !frequency.isSmoothing())
+    {
+        // в покое коэффициенты пересчитываются один раз, когда рампа закончилась
+        if (ramping)
+        {
+            updateCoefficients(0, tilt.getCurrentValue(), frequency.getCurrentValue());
+            numCoefficients = 1;
+            ramping = false;
+        }
+        return;
+    }
+    ramping = true;
+    numCoefficients = juce::jmin(static_cast<int>(pre.size()), (numSamples + EMPHASIS_UPDATE_INTERVAL - 1) / EMPHASIS_UPDATE_INTERVAL);
+    for (int i = 0; i < numCoefficients; ++i)
+    {
+        // коэффициенты подблока берутся в его середине
+        const int step{ juce::jmin(EMPHASIS_UPDATE_INTERVAL, numSamples - i * EMPHASIS_UPDATE_INTERVAL) };
+        const auto middleTilt{ tilt.skip(step / 2) };
+        const auto middleFrequency{ frequency.skip(step / 2) };
+        updateCoefficients(static_cast<size_t>(i), middleTilt, middleFrequency);
+        tilt.skip(step - step / 2);
+        frequency.skip(step - step / 2);
+    }
+}
+
+bool EmphasisFilter::isActive() const noexcept { return ramping || tilt.getCurrentValue() != 0.0f; }
+
+void EmphasisFilter::processPre(int channel, float* data, int numSamples) noexcept
+{
+    process(pre, preStates[static_cast<size_t>(channel)], data, numSamples);
+}
+
+void EmphasisFilter::processPost(int channel, float* data, int numSamples) noexcept
+{
+    process(post, postStates[static_cast<size_t>(channel)], data, numSamples);
+}
+
+void EmphasisFilter::process(const std::vector<Coefficients>& coefficients, State& state, float* data, int numSamples) const noexcept
+{
+    if (!ramping)
+    {
+        process(coefficients.front(), state, data, numSamples);
+        return;
+    }
+    for (int i = 0, start = 0; start < numSamples; ++i, start += EMPHASIS_UPDATE_INTERVAL)
+    {
+        const auto index{ static_cast<size_t>(juce::jmin(i, numCoefficients - 1)) };
+        process(coefficients[index], state, data + start, juce::jmin(EMPHASIS_UPDATE_INTERVAL, numSamples - start));
+    }
+}
+
+void EmphasisFilter::process(const Coefficients& coefficients, State& state, float* data, int numSamples) noexcept
+{
+    // коэффициенты и состояние в локальных переменных, чтобы компилятор держал их в регистрах
+    const auto b0{ coefficients.b0 }, b1{ coefficients.b1 }, b2{ coefficients.b2 };
+    const auto a1{ coefficients.a1 }, a2{ coefficients.a2 };
+    auto s1{ state[0] }, s2{ state[1] };
+    for (int i = 0; i < numSamples; ++i)
+    {
+        const auto input{ data[i] };
+        const auto output{ b0 * input + s1 };
+        s1 = b1 * input - a1 * output + s2;
+        s2 = b2 * input - a2 * output;
+        data[i] = output;
+    }
+    state[0] = s1;
+    state[1] = s2;
+}
+
+void EmphasisFilter::updateCoefficients(size_t index, float tiltInDb, float tiltFrequency) noexcept
+{
+    /* Высокая полка RBJ (S = 1) с усилением tilt, умноженная на -tilt/2 дБ:
+    ниже частоты наклона -tilt/2, выше +tilt/2, на самой частоте 0 дБ.
+    Множитель -tilt/2 дБ равен 1 / amplitude и уже сокращён с общим
+    множителем amplitude в числителе полки RBJ, поэтому числитель ниже
+    записан без него. Отдельно масштабировать b0..b2 не нужно. */
+    const double amplitude{ std::pow(10.0, tiltInDb / 40.0) };
+    const double omega{ juce::MathConstants<double>::twoPi
+                        * juce::jlimit(10.0, 0.45 * sampleRate, static_cast<double>(tiltFrequency)) / sampleRate };
+    const double cosine{ std::cos(omega) };
+    const double alpha{ std::sin(omega) * juce::MathConstants<double>::sqrt2 / 2.0 };
+    const double root{ 2.0 * std::sqrt(amplitude) * alpha };
+    const double b0{ (amplitude + 1.0) + (amplitude - 1.0) * cosine + root };
+    const double b1{ -2.0 * ((amplitude - 1.0) + (amplitude + 1.0) * cosine) };
+    const double b2{ (amplitude + 1.0) + (amplitude - 1.0) * cosine - root };
+    const double a0{ (amplitude + 1.0) - (amplitude - 1.0) * cosine + root };
+    const double a1{ 2.0 * ((amplitude - 1.0) - (amplitude + 1.0) * cosine) };
+    const double a2{ (amplitude + 1.0) - (amplitude - 1.0) * cosine - root };
+    pre[index] = { static_cast<float>(b0 / a0), static_cast<float>(b1 / a0), static_cast<float>(b2 / a0),
+                   static_cast<float>(a1 / a0), static_cast<float>(a2 / a0) };
+    post[index] = { static_cast<float>(a0 / b0), static_cast<float>(a1 / b0), static_cast<float>(a2 / b0),
+                    static_cast<float>(b1 / b0), static_cast<float>(b2 / b0) };
+}
+//==============================================================================
+void TruePeakLimiter::prepare(double newSampleRate, int numChannels)
+{
+    sampleRate = newSampleRate;
+    lookahead = juce::jmax(1, juce::roundToInt(sampleRate * LIMITER_LOOKAHEAD_MS * 0.001));
+    updateKernels();
+    history.assign(static_cast<size_t>(numChannels), {});
+    delayLine.setSize(numChannels, getLatencyInSamples() + 1);
+    queuePeaks.assign(static_cast<size_t>(lookahead + 1), 0.0f);
+    queueTimes.assign(static_cast<size_t>(lookahead + 1), 0);
+    smoothingHistory.assign(static_cast<size_t>(lookahead), 1.0f);
+    setReleaseInMs(releaseInMs);
+    reset();
+}
+
+void TruePeakLimiter::reset()
+{
+    delayLine.clear();
+    delayWritePosition = 0;
+    resetDetector();
+}
+
+void TruePeakLimiter::resume() noexcept
+{
+    /* Включение после задержки без детектора: отсчёты, уже лежащие в линии
+    задержки, прогоняются через детектор от старых к новым. Состояние
+    получается таким же, как если бы лимитер работал всё время, и пики,
+    пришедшие до включения, ограничиваются без щелчка. */
+    resetDetector();
+    const int numChannels{ delayLine.getNumChannels() };
+    const int delayLength{ delayLine.getNumSamples() };
+    for (int i = 1; i < delayLength; ++i)
+    {
+        const int position{ (delayWritePosition + i) % delayLength };
+        float peak{ 0.0f };
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            peak = juce::jmax(peak, detectPeak(static_cast<size_t>(channel), delayLine.getSample(channel, position)));
+        }
+        pushPeak(peak);
+    }
+}
+
+void TruePeakLimiter::resetDetector() noexcept
+{
+    for (auto& channelHistory : history) { channelHistory.fill(0.0f); }
+    queueHead = 0;
+    queueSize = 0;
+    sampleCounter = 0;
+    std::fill(smoothingHistory.begin(), smoothingHistory.end(), 1.0f);
+    smoothingSum = static_cast<double>(smoothingHistory.size());
+    smoothingPosition = 0;
+    envelope = 1.0f;
+}
+
+void TruePeakLimiter::setCeilingInDb(float newCeilingInDb) noexcept { ceiling = juce::Decibels::decibelsToGain(newCeilingInDb); }
+
+void TruePeakLimiter::setReleaseInMs(float newReleaseInMs) noexcept
+{
+    if (newReleaseInMs == releaseInMs && releaseCoefficient > 0.0f) { return; }
+    releaseInMs = newReleaseInMs;
+    releaseCoefficient = 1.0f - std::exp(-1.0f / (0.001f * releaseInMs * static_cast<float>(sampleRate)));
+}
+
+void TruePeakLimiter::setQuality(int newOversampling, int newInterpolationTaps) noexcept
+{
+    newOversampling = juce::jlimit(2, maxOversampling, newOversampling);
+    newInterpolationTaps = juce::jlimit(2, maxInterpolationTaps, newInterpolationTaps / 2 * 2);
+    if (newOversampling == oversampling && newInterpolationTaps == interpolationTaps) { return; }
+    /* Задержанный сигнал, очередь пиков и огибающая не сбрасываются,
+    поэтому переключение проходит без щелчков. Отсчёты перед прежним
+    firstTap не сдвигались и несколько отсчётов после переключения
+    слегка искажают оценку пика, что сглаживается окном усиления. */
+    oversampling = newOversampling;
+    interpolationTaps = newInterpolationTaps;
+    firstTap = detectorDelay - interpolationTaps / 2;
+    updateKernels();
+}
+
+void TruePeakLimiter::updateKernels() noexcept
+{
+    // ядра windowed sinc для дробных положений phase / oversampling между history[7] и history[8]
+    const auto halfWidth{ static_cast<float>(interpolationTaps / 2) };
+    for (int phase = 1; phase < oversampling; ++phase)
+    {
+        auto& kernel{ interpolationKernels[static_cast<size_t>(phase - 1)] };
+        kernel.fill(0.0f);
+        const float fraction{ static_cast<float>(phase) / oversampling };
+        float sum{ 0.0f };
+        for (int tap = firstTap; tap < firstTap + interpolationTaps; ++tap)
+        {
+            const float distance{ fraction - static_cast<float>(tap - (detectorDelay - 1)) };
+            const float sinc{ std::sin(juce::MathConstants<float>::pi * distance) / (juce::MathConstants<float>::pi * distance) };
+            const float window{ 0.5f + 0.5f * std::cos(juce::MathConstants<float>::pi * distance / halfWidth) };
+            kernel[static_cast<size_t>(tap)] = sinc * window;
+            sum += kernel[static_cast<size_t>(tap)];
+        }
+        for (auto& coefficient : kernel) { coefficient /= sum; }
+    }
+}
+
+int TruePeakLimiter::getLatencyInSamples() const noexcept { return lookahead + detectorDelay; }
+
+float TruePeakLimiter::detectPeak(size_t channel, float sample) noexcept
+{
+    // отсчёты до firstTap короткому ядру не нужны и не сдвигаются
+    auto& channelHistory{ history[channel] };
+    std::copy(channelHistory.begin() + firstTap + 1, channelHistory.end(), channelHistory.begin() + firstTap);
+    channelHistory.back() = sample;
+    float peak{ std::abs(channelHistory[static_cast<size_t>(detectorDelay - 1)]) };
+    for (int phase = 0; phase < oversampling - 1; ++phase)
+    {
+        const auto& kernel{ interpolationKernels[static_cast<size_t>(phase)] };
+        float interpolated{ 0.0f };
+        for (int tap = firstTap; tap < firstTap + interpolationTaps; ++tap)
+        {
+            interpolated += kernel[static_cast<size_t>(tap)] * channelHistory[static_cast<size_t>(tap)];
+        }
+        peak = juce::jmax(peak, std::abs(interpolated));
+    }
+    return peak;
+}
+
+float TruePeakLimiter::pushPeak(float peak) noexcept
+{
+    const int queueCapacity{ static_cast<int>(queuePeaks.size()) };
+    const int smoothingLength{ static_cast<int>(smoothingHistory.size()) };
+    // из окна уходит не больше одного пика за отсчёт, поэтому очередь не переполняется
+    if (queueSize > 0 && queueTimes[static_cast<size_t>(queueHead)] <= sampleCounter - queueCapacity)
+    {
+        queueHead = (queueHead + 1) % queueCapacity;
+        --queueSize;
+    }
+    // монотонная очередь: более слабые пики позади нового уже никогда не станут максимумом
+    while (queueSize > 0 && queuePeaks[static_cast<size_t>((queueHead + queueSize - 1) % queueCapacity)] <= peak) { --queueSize; }
+    const auto tail{ static_cast<size_t>((queueHead + queueSize) % queueCapacity) };
+    queuePeaks[tail] = peak;
+    queueTimes[tail] = sampleCounter;
+    ++queueSize;
+    ++sampleCounter;
+    const float maxPeak{ queuePeaks[static_cast<size_t>(queueHead)] };
+    const float heldGain{ maxPeak > ceiling ? ceiling / maxPeak : 1.0f };
+    envelope = heldGain < envelope ? heldGain : envelope + releaseCoefficient * (heldGain - envelope);
+    smoothingSum += static_cast<double>(envelope - smoothingHistory[static_cast<size_t>(smoothingPosition)]);
+    smoothingHistory[static_cast<size_t>(smoothingPosition)] = envelope;
+    smoothingPosition = (smoothingPosition + 1) % smoothingLength;
+    return static_cast<float>(smoothingSum / smoothingLength);
+}
+
+void TruePeakLimiter::process(juce::AudioBuffer<float>& buffer, bool applyGain) noexcept
+{
+    const int numChannels{ juce::jmin(buffer.getNumChannels(), delayLine.getNumChannels()) };
+    const int delayLength{ delayLine.getNumSamples() };
+    for (int i = 0; i < buffer.getNumSamples(); ++i)
+    {
+        float peak{ 0.0f };
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            const float sample{ buffer.getSample(channel, i) };
+            peak = juce::jmax(peak, detectPeak(static_cast<size_t>(channel), sample));
+            delayLine.setSample(channel, delayWritePosition, sample);
+        }
+        const float smoothedGain{ pushPeak(peak) };
+        const float gain{ applyGain ? smoothedGain : 1.0f };
+
+        const int readPosition{ (delayWritePosition + 1) % delayLength }; // самый старый отсчёт линии задержки
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            buffer.setSample(channel, i, delayLine.getSample(channel, readPosition) * gain);
+        }
+        delayWritePosition = readPosition;
+    }
+}
+
+void TruePeakLimiter::delay(juce::AudioBuffer<float>& buffer) noexcept
+{
+    // та же линия задержки без детектора: resume продолжит с её содержимым
+    const int numChannels{ juce::jmin(buffer.getNumChannels(), delayLine.getNumChannels()) };
+    const int delayLength{ delayLine.getNumSamples() };
+    for (int i = 0; i < buffer.getNumSamples(); ++i)
+    {
+        const int readPosition{ (delayWritePosition + 1) % delayLength };
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            delayLine.setSample(channel, delayWritePosition, buffer.getSample(channel, i));
+            buffer.setSample(channel, i, delayLine.getSample(channel, readPosition));
+        }
+        delayWritePosition = readPosition;
+    }
+}
 //==============================================================================
 void GainController::setInputGainLevelInDb(const double& value) { inputGainInDb = value; }
 
@@ -422,6 +2381,272 @@ void GainController::setBypassState(const bool& newState) { bypassed = newState;
 
 bool GainController::getBypassState() const { return bypassed; }
 //==============================================================================
+void ProcessLoadMeter::prepare(double newSampleRate, int samplesPerBlock)
+{
+    sampleRate = newSampleRate;
+    ticksPerSecond = static_cast<double>(juce::Time::getHighResolutionTicksPerSecond());
+    blocksPerHistogram = juce::jmax(1, static_cast<int>(2.0 * sampleRate / juce::jmax(1, samplesPerBlock)));
+    budgetSeconds.store(samplesPerBlock / sampleRate);
+    resetRequested.store(false);
+    clear();
+}
+
+void ProcessLoadMeter::beginBlock() noexcept
+{
+    if (resetRequested.exchange(false)) { clear(); }
+    blockStartTicks = juce::Time::getHighResolutionTicks();
+    blockStartCycles = readCycleCounter();
+    stageStartCycles = blockStartCycles;
+    stageCycles.fill(0);
+}
+
+void ProcessLoadMeter::markStage(LoadStage stage) noexcept
+{
+    const auto now{ readCycleCounter() };
+    stageCycles[stage] += now - stageStartCycles;
+    stageStartCycles = now;
+}
+
+void ProcessLoadMeter::endBlock(int numSamples) noexcept
+{
+    const auto endTicks{ juce::Time::getHighResolutionTicks() };
+    const auto endCycles{ readCycleCounter() };
+    if (numSamples <= 0) { return; }
+    const double budget{ numSamples / sampleRate };
+    const double seconds{ static_cast<double>(endTicks - blockStartTicks) / ticksPerSecond };
+    const double load{ seconds / budget };
+    lastLoad = load;
+    // частота счётчика циклов калибруется по каждому блоку
+    const double cyclesPerSecond{ seconds > 0.0 ? static_cast<double>(endCycles - blockStartCycles) / seconds : 0.0 };
+
+    const double average{ averageLoad.load(std::memory_order_relaxed) };
+    averageLoad.store(average + smoothing * (load - average), std::memory_order_relaxed);
+    if (load > worstLoad.load(std::memory_order_relaxed)) { worstLoad.store(load, std::memory_order_relaxed); }
+    for (size_t i = 0; i < stageCycles.size(); ++i)
+    {
+        const double stageShare{ cyclesPerSecond > 0.0 ? static_cast<double>(stageCycles[i]) / cyclesPerSecond / budget : 0.0 };
+        const double stageAverage{ stageLoad[i].load(std::memory_order_relaxed) };
+        stageLoad[i].store(stageAverage + smoothing * (stageShare - stageAverage), std::memory_order_relaxed);
+    }
+
+    auto& histogram{ histograms[static_cast<size_t>(activeHistogram.load(std::memory_order_relaxed))] };
+    const auto bin{ juce::jlimit(0, numBins - 1, static_cast<int>(load * 100.0)) };
+    histogram[static_cast<size_t>(bin)].fetch_add(1, std::memory_order_relaxed);
+    numBlocks.fetch_add(1, std::memory_order_relaxed);
+    if (++blocksInHistogram >= blocksPerHistogram)
+    {
+        const int nextHistogram{ 1 - activeHistogram.load(std::memory_order_relaxed) };
+        for (auto& count : histograms[static_cast<size_t>(nextHistogram)]) { count.store(0, std::memory_order_relaxed); }
+        activeHistogram.store(nextHistogram, std::memory_order_relaxed);
+        blocksInHistogram = 0;
+    }
+}
+
+LoadStatistics ProcessLoadMeter::getStatistics() const
+{
+    LoadStatistics statistics;
+    statistics.budgetMs = 1000.0 * budgetSeconds.load(std::memory_order_relaxed);
+    statistics.average = averageLoad.load(std::memory_order_relaxed);
+    statistics.worst = worstLoad.load(std::memory_order_relaxed);
+    statistics.numBlocks = numBlocks.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < stageLoad.size(); ++i) { statistics.stageAverage[i] = stageLoad[i].load(std::memory_order_relaxed); }
+
+    std::array<juce::uint64, numBins> counts{};
+    juce::uint64 total{ 0 };
+    for (const auto& histogram : histograms)
+    {
+        for (size_t bin = 0; bin < counts.size(); ++bin)
+        {
+            counts[bin] += histogram[bin].load(std::memory_order_relaxed);
+        }
+    }
+    for (auto count : counts) { total += count; }
+    juce::uint64 cumulative{ 0 };
+    for (size_t bin = 0; bin < counts.size() && total > 0; ++bin)
+    {
+        cumulative += counts[bin];
+        if (cumulative * 100 >= total * 99)
+        {
+            statistics.p99 = static_cast<double>(bin + 1) / 100.0;
+            break;
+        }
+    }
+    return statistics;
+}
+
+double ProcessLoadMeter::getLastLoad() const noexcept { return lastLoad; }
+
+void ProcessLoadMeter::requestReset() noexcept { resetRequested.store(true); }
+
+void ProcessLoadMeter::clear() noexcept
+{
+    for (auto& histogram : histograms)
+    {
+        for (auto& count : histogram) { count.store(0, std::memory_order_relaxed); }
+    }
+    for (auto& stage : stageLoad) { stage.store(0.0, std::memory_order_relaxed); }
+    averageLoad.store(0.0, std::memory_order_relaxed);
+    worstLoad.store(0.0, std::memory_order_relaxed);
+    numBlocks.store(0, std::memory_order_relaxed);
+    blocksInHistogram = 0;
+}
+//==============================================================================
+std::atomic<Tracer*> Tracer::activeTracer{ nullptr };
+
+Tracer::Tracer() : juce::Thread("Trace writer")
+{
+    activeTracer.store(this, std::memory_order_release);
+    const auto path{ juce::SystemStats::getEnvironmentVariable("DESTRUCTION_TRACE_FILE", {}) };
+    if (path.isNotEmpty()) { start(juce::File::getCurrentWorkingDirectory().getChildFile(path)); }
+}
+
+Tracer::~Tracer()
+{
+    stop();
+    activeTracer.store(nullptr, std::memory_order_release);
+}
+
+bool Tracer::start(const juce::File& file)
+{
+    if (isEnabled()) { return true; }
+    file.deleteFile();
+    stream = std::make_unique<juce::FileOutputStream>(file);
+    if (stream->failedToOpen())
+    {
+        DBG("Failed to open trace file");
+        stream.reset();
+        return false;
+    }
+    // пул буферов выделяется один раз и живёт до удаления Tracer
+    if (bufferStorage == nullptr)
+    {
+        bufferStorage = std::make_unique<BufferPool>();
+        buffers.store(bufferStorage.get(), std::memory_order_release);
+    }
+    for (auto& buffer : *bufferStorage) { buffer.named = false; }
+    ticksToMicroseconds = 1.0e6 / static_cast<double>(juce::Time::getHighResolutionTicksPerSecond());
+    originTicks = juce::Time::getHighResolutionTicks();
+    firstEvent = true;
+    *stream << "{\"traceEvents\":[\n";
+    enabled.store(true, std::memory_order_release);
+    startThread();
+    return true;
+}
+
+void Tracer::stop()
+{
+    if (!isEnabled()) { return; }
+    enabled.store(false, std::memory_order_release);
+    stopThread(1000);
+    flush();
+    *stream << "\n],\"displayTimeUnit\":\"ms\",\"droppedEvents\":" << static_cast<int>(droppedEvents.load()) << "}\n";
+    stream.reset();
+}
+
+void Tracer::addEvent(const char* name, juce::int64 startTicks, juce::int64 endTicks) noexcept
+{
+    if (!isEnabled()) { return; }
+    auto* pool{ buffers.load(std::memory_order_acquire) };
+    if (pool == nullptr) { return; }
+    const auto threadId{ juce::Thread::getCurrentThreadId() };
+    auto& slot{ getThreadSlot() };
+    if (slot.index < 0 || (*pool)[static_cast<size_t>(slot.index)].owner.load(std::memory_order_relaxed) != threadId)
+    {
+        slot.index = claimBuffer(*pool, threadId);
+    }
+    if (slot.index < 0 || !(*pool)[static_cast<size_t>(slot.index)].events.push({ name, startTicks, endTicks }))
+    {
+        droppedEvents.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+int Tracer::claimBuffer(BufferPool& pool, juce::Thread::ThreadID threadId) noexcept
+{
+    for (size_t index = 0; index < pool.size(); ++index)
+    {
+        // свободный буфер закрепляется за потоком без блокировок
+        auto& buffer{ pool[index] };
+        juce::Thread::ThreadID expected{ nullptr };
+        if (buffer.owner.compare_exchange_strong(expected, threadId, std::memory_order_acq_rel))
+        {
+            buffer.traceThreadId = nextTraceThreadId.fetch_add(1, std::memory_order_relaxed);
+            buffer.isMessageThread = juce::MessageManager::existsAndIsCurrentThread();
+            buffer.active.store(true, std::memory_order_release);
+            return static_cast<int>(index);
+        }
+    }
+    return -1;
+}
+
+void Tracer::releaseBuffer(int index) noexcept
+{
+    auto* pool{ buffers.load(std::memory_order_acquire) };
+    if (pool == nullptr) { return; }
+    auto& buffer{ (*pool)[static_cast<size_t>(index)] };
+    if (buffer.owner.load(std::memory_order_relaxed) == juce::Thread::getCurrentThreadId())
+    {
+        buffer.released.store(true, std::memory_order_release);
+    }
+}
+
+Tracer::ThreadSlot::~ThreadSlot()
+{
+    if (index < 0) { return; }
+    if (auto* tracer{ Tracer::getActive() }) { tracer->releaseBuffer(index); }
+}
+
+void Tracer::run()
+{
+    while (!threadShouldExit())
+    {
+        wait(100);
+        flush();
+    }
+}
+
+void Tracer::flush()
+{
+    auto* pool{ buffers.load(std::memory_order_acquire) };
+    if (stream == nullptr || pool == nullptr) { return; }
+    const int processId{ 1 };
+    TraceEvent event;
+    for (auto& buffer : *pool)
+    {
+        if (!buffer.active.load(std::memory_order_acquire)) { continue; }
+        // флаг читается до сброса событий, чтобы не потерять последние события потока
+        const bool released{ buffer.released.load(std::memory_order_acquire) };
+        const int tid{ buffer.traceThreadId };
+        auto writeSeparator = [this]()
+        {
+            if (!firstEvent) { *stream << ",\n"; }
+            firstEvent = false;
+        };
+        if (!buffer.named)
+        {
+            writeSeparator();
+            *stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << processId << ",\"tid\":" << tid
+                    << ",\"args\":{\"name\":\"" << (buffer.isMessageThread ? "Message thread" : "Thread " + juce::String(tid)) << "\"}}";
+            buffer.named = true;
+        }
+        while (buffer.events.pull(event))
+        {
+            writeSeparator();
+            *stream << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":" << processId << ",\"tid\":" << tid
+                    << ",\"ts\":" << juce::String(static_cast<double>(event.startTicks - originTicks) * ticksToMicroseconds, 3)
+                    << ",\"dur\":" << juce::String(static_cast<double>(event.endTicks - event.startTicks) * ticksToMicroseconds, 3) << "}";
+        }
+        if (released)
+        {
+            // поток завершился и его события записаны: буфер возвращается в пул
+            buffer.named = false;
+            buffer.released.store(false, std::memory_order_relaxed);
+            buffer.active.store(false, std::memory_order_relaxed);
+            buffer.owner.store(nullptr, std::memory_order_release);
+        }
+    }
+    stream->flush();
+}
+//==============================================================================
 // This creates new instances of the plugin..
 juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
 {
@@ -430,16 +2655,57 @@ juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
 
 APVTS::ParameterLayout DestructionAudioProcessor::createParameterLayout()
 {
-    juce::StringArray clipTypes{ "Hard Clip", "Soft Clip", "Fold Back", "Sine Fold", "Linear Fold" };
-    return APVTS::ParameterLayout
+    juce::StringArray clipTypes{ "Hard Clip", "Soft Clip", "Fold Back", "Sine Fold", "Linear Fold", "Custom" };
+    APVTS::ParameterLayout layout
     {
         std::make_unique<juce::AudioParameterFloat>("Input Gain", "Input Gain", -12.0f, 12.0f, 0.0f),
         std::make_unique<juce::AudioParameterFloat>("Clip", "Clip", 1.0f, 10.0f, 1.0f),
         std::make_unique<juce::AudioParameterFloat>("Output Gain", "Output Gain", -12.0f, 12.0f, 0.0f),
         std::make_unique<juce::AudioParameterChoice>("Clipper Type", "Clipper Type", clipTypes, hard),
         std::make_unique<juce::AudioParameterBool>("Bypass", "Bypass", false),
-        std::make_unique<juce::AudioParameterBool>("Link", "Link", true)
+        std::make_unique<juce::AudioParameterBool>("Link", "Link", true),
+        std::make_unique<juce::AudioParameterFloat>("Morph", "Morph", 0.0f, 1.0f, 0.0f),
+        std::make_unique<juce::AudioParameterInt>("Stages", "Stages", 1, MAX_CLIP_STAGES, 1),
+        std::make_unique<juce::AudioParameterBool>("Auto Gain", "Auto Gain", false),
+        std::make_unique<juce::AudioParameterFloat>("Mix", "Mix", 0.0f, 1.0f, 1.0f),
+        std::make_unique<juce::AudioParameterFloat>("Emphasis", "Emphasis", -EMPHASIS_MAX_DB, EMPHASIS_MAX_DB, 0.0f),
+        std::make_unique<juce::AudioParameterFloat>("Emphasis Frequency", "Emphasis Frequency",
+                                                    juce::NormalisableRange<float>(100.0f, 8000.0f, 1.0f, 0.3f), 1000.0f),
+        std::make_unique<juce::AudioParameterFloat>("Sidechain Drive", "Sidechain Drive",
+                                                    -SIDECHAIN_MAX_DRIVE_DB, SIDECHAIN_MAX_DRIVE_DB, 0.0f),
+        std::make_unique<juce::AudioParameterFloat>("Sidechain Attack", "Sidechain Attack",
+                                                    juce::NormalisableRange<float>(0.1f, 100.0f, 0.1f, 0.4f), 5.0f),
+        std::make_unique<juce::AudioParameterFloat>("Sidechain Release", "Sidechain Release",
+                                                    juce::NormalisableRange<float>(5.0f, 1000.0f, 1.0f, 0.4f), 100.0f),
+        std::make_unique<juce::AudioParameterBool>("Transient Split", "Transient Split", false),
+        std::make_unique<juce::AudioParameterFloat>("Transient Clip", "Transient Clip", 1.0f, 10.0f, 1.0f),
+        std::make_unique<juce::AudioParameterBool>("Limiter", "Limiter", false),
+        std::make_unique<juce::AudioParameterFloat>("Limiter Ceiling", "Limiter Ceiling", -12.0f, 0.0f, -0.3f),
+        std::make_unique<juce::AudioParameterFloat>("Limiter Release", "Limiter Release", 1.0f, 500.0f, 50.0f),
+        std::make_unique<juce::AudioParameterBool>("CPU Governor", "CPU Governor", false)
     };
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Mod Target", "Mod Target", ModulationEngine::targetNames, ModulationEngine::off),
+               std::make_unique<juce::AudioParameterChoice>("Mod Shape", "Mod Shape", ModulationEngine::shapeNames, ModulationEngine::sine),
+               std::make_unique<juce::AudioParameterChoice>("Mod Rate", "Mod Rate", ModulationEngine::rateNames, 2),
+               std::make_unique<juce::AudioParameterFloat>("Mod Depth", "Mod Depth", 0.0f, 1.0f, 0.5f));
+    for (int step = 1; step <= MOD_NUM_STEPS; ++step)
+    {
+        const auto name{ "Mod Step " + juce::String(step) };
+        layout.add(std::make_unique<juce::AudioParameterFloat>(name, name, 0.0f, 1.0f, step % 2 == 1 ? 1.0f : 0.0f));
+    }
+    // первая ступень каскада - основные Clipper Type и Clip, остальные добавляются после неё
+    for (int stage = 2; stage <= MAX_CLIP_STAGES; ++stage)
+    {
+        const auto prefix{ "Stage " + juce::String(stage) + " " };
+        layout.add(std::make_unique<juce::AudioParameterChoice>(prefix + "Type", prefix + "Type", clipTypes, 0),
+                   std::make_unique<juce::AudioParameterFloat>(prefix + "Clip", prefix + "Clip", 1.0f, 10.0f, 1.0f),
+                   std::make_unique<juce::AudioParameterFloat>(prefix + "Gain", prefix + "Gain", -12.0f, 12.0f, 0.0f));
+    }
+    return layout;
 }
 
-PresetManager& DestructionAudioProcessor::getPresetManager() { return *manager; }
\ No newline at end of file
+PresetManager& DestructionAudioProcessor::getPresetManager() { return *manager; }
+
+SpectrumAnalyzer& DestructionAudioProcessor::getSpectrumAnalyzer() { return spectrum; }
+
+HarmonicAnalysisService& DestructionAudioProcessor::getHarmonicAnalysis() { return harmonicAnalysis; }
\ No newline at end of file
@@ -9,8 +9,21 @@
 #pragma once
 
 #include <JuceHeader.h>
+#if JUCE_INTEL
+    #if JUCE_MSVC
+        #include <intrin.h>
+    #else
+        #include <x86intrin.h>
+    #endif
+#endif
 
 #define OSC false
+#ifndef TRACING
+    #define TRACING 0 // 1 - сборка с поддержкой трассировки, запись включается переменной DESTRUCTION_TRACE_FILE
+#endif
+#ifndef RT_SAFETY_CHECK
+    #define RT_SAFETY_CHECK JUCE_DEBUG // разметка аудиопотока для детектора выделений памяти и блокировок
+#endif
 //========================================
 // Clipper correction coefficients
 #define HARDCLIP_COEF 0.75
@@ -18,13 +31,72 @@
 #define FOLDBACK_COEF 0.5
 #define SINEFOLD_COEF 0.75
 #define LINEARFOLD_COEF 0.75
+#define CUSTOM_COEF 0.75
+// Custom transfer curve
+#define CURVE_TABLE_SIZE 1024
+// Clipping chain
+#define MAX_CLIP_STAGES 4
+// Emphasis filters
+#define EMPHASIS_MAX_DB 12.0f
+#define EMPHASIS_UPDATE_INTERVAL 32 // отсчётов между пересчётами коэффициентов, пока наклон сглаживается
+// Sidechain drive
+#define SIDECHAIN_MAX_DRIVE_DB 24.0f
+// Transient split
+#define TRANSIENT_FAST_ATTACK_MS 0.5f
+#define TRANSIENT_FAST_RELEASE_MS 20.0f
+#define TRANSIENT_SLOW_ATTACK_MS 15.0f
+#define TRANSIENT_SLOW_RELEASE_MS 150.0f
+// MIDI control
+#define MIDI_CC_CLIP 20
+#define MIDI_CC_CLIPPER_TYPE 21
+#define MIDI_CC_BYPASS 22
+#define MIDI_NOTE_FIRST_CLIPPER 36 // C1..F1 выбирают тип клиппера
+#define MIDI_NOTE_BYPASS 48 // C2: байпас, пока нота нажата
+#define MIN_SUBBLOCK_SIZE 32 // события ближе этого к началу куска применяются в его начале (при воспроизведении)
+// Modulation
+#define MOD_CONTROL_INTERVAL 32 // отсчётов между точками управляющего сигнала при воспроизведении
+#define MOD_NUM_STEPS 8
+// Output limiter
+#define LIMITER_LOOKAHEAD_MS 1.5
+
+#define GOVERNOR_HIGH_LOAD 0.7 // доля бюджета блока, выше которой качество понижается
+#define GOVERNOR_LOW_LOAD 0.35 // ниже этой доли качество возвращается
+#define GOVERNOR_HOLD_MS 500.0 // пауза после переключения, пока среднее не установится
+#define GOVERNOR_RECOVERY_MS 3000.0 // сколько должен держаться запас перед повышением качества
+
+#define SPECTRUM_FFT_ORDER 11 // окно 2048 отсчётов
+#define SPECTRUM_OVERLAP 4 // новое окно каждые 512 отсчётов
+#define SPECTRUM_NUM_BINS 128 // логарифмические полосы от 20 Гц до 20 кГц
+#define SPECTRUM_PEAK_HOLD_MS 1000.0
+
+#define HARMONIC_MAX_ORDER 20
+#define HARMONIC_FFT_ORDER 14 // 16384 отсчётов
+#define HARMONIC_TEST_BIN 331 // простое: ~970 Гц при 48 кГц, отражённые гармоники не ложатся на гармонические бины
+#define HARMONIC_TEST_AMPLITUDE 0.5 // -6 dBFS
+#define HARMONIC_SAMPLE_RATE 48000.0
 // Sensitivities
 #define SLOW_SENS 125
 #define NORM_SENS 250
+// Plugin state format
+#define STATE_MAGIC 0x44535442 // "DSTB"
+#define STATE_FORMAT_VERSION 3 // 2: добавлены точки пользовательской кривой, 3: ключи параметров - CRC-32
 //========================================
 typedef juce::AudioProcessorValueTreeState APVTS;
 //==============================================================================
-enum ClipperType { hard = 1, soft, foldback, sinefold, linearfold };
+inline juce::uint32 getStateParameterKey(const juce::String& parameterID) noexcept
+    /* CRC-32 (IEEE 802.3) от UTF-8 идентификатора параметра - ключ в бинарном
+    состоянии. В отличие от String::hashCode, определён независимо от JUCE. */
+{
+    juce::uint32 crc{ 0xffffffffu };
+    for (auto* character{ parameterID.toRawUTF8() }; *character != 0; ++character)
+    {
+        crc ^= static_cast<juce::uint8>(*character);
+        for (int bit = 0; bit < 8; ++bit) { crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1u))); }
+    }
+    return ~crc;
+}
+//==============================================================================
+enum ClipperType { hard = 1, soft, foldback, sinefold, linearfold, custom };
 //==============================================================================
 template <typename Type, size_t size>
 class Fifo
@@ -61,17 +133,63 @@ public:
         auto writeIndex = fifo.write(1);
         if (writeIndex.blockSize1 > 0)
         {
-            buffers[writeIndex.startIndex1] = t;
+            copyInto(buffers[writeIndex.startIndex1], t);
             return true;
         }
         else { return false; }
     }
 
 private:
+    template <typename SampleType>
+    static void copyInto(juce::AudioBuffer<SampleType>& destination, const juce::AudioBuffer<SampleType>& source)
+    {
+        /* Оператор присваивания AudioBuffer перевыделяет память при любом
+        несовпадении размеров, поэтому блок меньше подготовленного копируется
+        в уже выделенный буфер без переаллокации. */
+        destination.setSize(source.getNumChannels(), source.getNumSamples(), false, false, true);
+        for (int channel = 0; channel < source.getNumChannels(); ++channel)
+        {
+            destination.copyFrom(channel, 0, source, channel, 0, source.getNumSamples());
+        }
+    }
+
+    template <typename Other>
+    static void copyInto(Other& destination, const Other& source) { destination = source; }
+
     juce::AbstractFifo fifo{ size };
     std::array<Type, size> buffers;
 };
 //==============================================================================
+template <typename Type>
+class TripleBuffer
+    /* Передача последнего значения из одного потока в другой без блокировок
+    и выделения памяти. Писатель заполняет свободный слот и атомарно меняет
+    его местами с промежуточным, читатель забирает промежуточный слот только
+    если там появилось новое значение. Промежуточные значения могут
+    теряться, последнее - никогда, в отличие от переполненного Fifo. */
+{
+public:
+    Type& getWriteBuffer() noexcept { return buffers[static_cast<size_t>(writeIndex)]; }
+
+    void publish() noexcept { writeIndex = middle.exchange(writeIndex | dirtyFlag, std::memory_order_acq_rel) & indexMask; }
+
+    bool update() noexcept
+    {
+        if ((middle.load(std::memory_order_acquire) & dirtyFlag) == 0) { return false; }
+        readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & indexMask;
+        return true;
+    }
+
+    const Type& getReadBuffer() const noexcept { return buffers[static_cast<size_t>(readIndex)]; }
+private:
+    static constexpr int dirtyFlag{ 4 };
+    static constexpr int indexMask{ 3 };
+    std::array<Type, 3> buffers;
+    int writeIndex{ 0 }; // только поток писателя
+    int readIndex{ 1 }; // только поток читателя
+    std::atomic<int> middle{ 2 };
+};
+//==============================================================================
 template <typename SampleType>
 class Clipper
     /* Базовый класс, предназначенный для модернизации различными
@@ -83,7 +201,30 @@ public:
     Clipper(double&& corrCoef = 1.0) : correctionCoefficient(corrCoef) { }
     virtual ~Clipper() { }
     virtual SampleType process(SampleType& sample) = 0;
-    virtual void updateMultiplier(double newValue) { multiplier = correctionCoefficient * newValue - getOffset(); }
+    virtual void processBlock(SampleType* samples, int numSamples)
+    {
+        /* Блочная обработка. Наследники переопределяют её быстрыми ядрами
+        с вынесенными из цикла константами, а process остаётся эталоном. */
+        for (int i = 0; i < numSamples; ++i) { samples[i] = process(samples[i]); }
+    }
+    virtual void processModulatedBlock(SampleType* samples, const SampleType* gains, int numSamples)
+    {
+        /* То же с посэмпловым отношением multiplier (динамический драйв,
+        транзиенты, модуляция Clip). Каждый сэмпл обрабатывается так, как
+        process обработал бы его при multiplier * gains[i], вместе с нормировкой,
+        поэтому выход не выходит за ±1 при любом gains. */
+        const auto baseMultiplier{ multiplier };
+        for (int i = 0; i < numSamples; ++i)
+        {
+            multiplier = baseMultiplier * static_cast<double>(gains[i]);
+            samples[i] = process(samples[i]);
+        }
+        multiplier = baseMultiplier;
+    }
+    virtual void updateMultiplier(double newValue) { multiplier = getMultiplierFor(newValue); }
+    double getMultiplier() const noexcept { return multiplier; }
+    double getMultiplierFor(double clip) const { return correctionCoefficient * clip - getOffset(); }
+    double getClip() const { return (multiplier + getOffset()) / correctionCoefficient; } // обратное updateMultiplier
 protected:
     virtual const double& getOffset() const { return correctionOffset; }
 
@@ -101,11 +242,35 @@ template <typename SampleType>
 class HardClipper : public Clipper<SampleType>
 {
 public:
+    using Clipper<SampleType>::multiplier;
+    using Clipper<SampleType>::correctionCoefficient;
+
     HardClipper(double&& corrCoef = 1.0) : Clipper<SampleType>(std::move(corrCoef)) { }
     SampleType process(SampleType& sample) override
     {
         return static_cast<SampleType>(juce::jlimit<double>(-1.0, 1.0, static_cast<double>(sample) * multiplier));
     }
+    void processBlock(SampleType* samples, int numSamples) override
+    {
+        const auto gain{ static_cast<SampleType>(multiplier) };
+        for (int i = 0; i < numSamples; ++i)
+        {
+            samples[i] = juce::jlimit(static_cast<SampleType>(-1), static_cast<SampleType>(1), samples[i] * gain);
+        }
+    }
+    void processModulatedBlock(SampleType* samples, const SampleType* gains, int numSamples) override
+    {
+        const auto gain{ static_cast<SampleType>(multiplier) };
+        for (int i = 0; i < numSamples; ++i)
+        {
+            samples[i] = juce::jlimit(static_cast<SampleType>(-1), static_cast<SampleType>(1), samples[i] * gains[i] * gain);
+        }
+    }
+    static SampleType getNormalization(SampleType) noexcept { return static_cast<SampleType>(1); }
+    SampleType processSample(SampleType sample, SampleType gain, SampleType) const noexcept
+    {
+        return juce::jlimit(static_cast<SampleType>(-1), static_cast<SampleType>(1), sample * gain);
+    }
 private:
     virtual const double& getOffset() const override { return correctionOffset; }
 
@@ -116,6 +281,8 @@ template <typename SampleType>
 class SoftClipper : public Clipper<SampleType>
 {
 public:
+    using Clipper<SampleType>::multiplier;
+
     SoftClipper(double&& corrCoef = 1.0) : Clipper<SampleType>(std::move(corrCoef)) { }
     SampleType process(SampleType& sample) override
     {
@@ -123,12 +290,38 @@ public:
             { return (std::atan(static_cast<double>(sample) * multiplier)); };
         return static_cast<SampleType>(juce::jmap<double>(updatedSample(sample), updatedSample(-1.0), updatedSample(1.0), -1.0, 1.0));
     }
+    void processBlock(SampleType* samples, int numSamples) override
+    {
+        // нормировка по atan(±multiplier) вынесена из цикла: один atan на сэмпл вместо трёх
+        const auto gain{ static_cast<SampleType>(multiplier) };
+        const auto normalization{ static_cast<SampleType>(1.0 / std::atan(multiplier)) };
+        for (int i = 0; i < numSamples; ++i) { samples[i] = std::atan(samples[i] * gain) * normalization; }
+    }
+    void processModulatedBlock(SampleType* samples, const SampleType* gains, int numSamples) override
+    {
+        // нормировка следует за посэмпловым множителем: второй atan на сэмпл
+        const auto gain{ static_cast<SampleType>(multiplier) };
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const auto sampleGain{ gains[i] * gain };
+            samples[i] = std::atan(samples[i] * sampleGain) / std::atan(sampleGain);
+        }
+    }
+    /* Посэмпловый закон для каскада: множитель и нормировка приходят
+    извне, чтобы нормировку можно было посчитать один раз на все каналы. */
+    static SampleType getNormalization(SampleType gain) noexcept { return static_cast<SampleType>(1) / std::atan(gain); }
+    SampleType processSample(SampleType sample, SampleType gain, SampleType normalization) const noexcept
+    {
+        return std::atan(sample * gain) * normalization;
+    }
 };
 //==============================================================================
 template <typename SampleType>
 class FoldbackClipper : public Clipper<SampleType>
 {
 public:
+    using Clipper<SampleType>::multiplier;
+
     FoldbackClipper(double&& corrCoef = 1.0) : Clipper<SampleType>(std::move(corrCoef)) { }
     SampleType process(SampleType& sample) override
     {
@@ -150,14 +343,51 @@ public:
                                                           -1.0,
                                                           1.0));
     }
+    void processBlock(SampleType* samples, int numSamples) override
+    {
+        const auto normalization{ static_cast<SampleType>(1.0 / std::atan(multiplier)) };
+        processKernel(samples, numSamples, [gain = static_cast<SampleType>(multiplier)](int) { return gain; },
+                      [normalization](SampleType) { return normalization; });
+    }
+    void processModulatedBlock(SampleType* samples, const SampleType* gains, int numSamples) override
+    {
+        processKernel(samples, numSamples, [gains, gain = static_cast<SampleType>(multiplier)](int i) { return gains[i] * gain; },
+                      [](SampleType sampleGain) { return getNormalization(sampleGain); });
+    }
+    static SampleType getNormalization(SampleType gain) noexcept { return static_cast<SampleType>(1) / std::atan(gain); }
+    SampleType processSample(SampleType sample, SampleType gain, SampleType normalization) const noexcept
+    {
+        const auto newSample{ std::atan(sample * gain) };
+        const auto magnitude{ std::abs(newSample) };
+        auto foldbackMultiplier{ static_cast<SampleType>(1) };
+        if (magnitude >= knee)
+        {
+            foldbackMultiplier += (magnitude - knee) * kneeScale * (std::abs(sample) * gain - static_cast<SampleType>(1));
+        }
+        return newSample / foldbackMultiplier * normalization;
+    }
 private:
+    template <typename GainFunction, typename NormalizationFunction>
+    void processKernel(SampleType* samples, int numSamples, GainFunction getGain, NormalizationFunction getSampleNormalization)
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const auto gain{ getGain(i) };
+            samples[i] = processSample(samples[i], gain, getSampleNormalization(gain));
+        }
+    }
+
     double kneeThreshold{ 0.5 }; // влияет на резкость звучания. Должен быть от 0,2 до 0,7 (найдено эмпирически)
+    const SampleType knee{ static_cast<SampleType>(kneeThreshold) };
+    const SampleType kneeScale{ static_cast<SampleType>(1.0 / (1.0 - kneeThreshold)) };
 };
 //==============================================================================
 template <typename SampleType>
 class SineFoldClipper : public Clipper<SampleType>
 {
 public:
+    using Clipper<SampleType>::multiplier;
+
     SineFoldClipper(double&& corrCoef = 1.0) : Clipper<SampleType>(std::move(corrCoef)) { }
     SampleType process(SampleType& sample) override
     {
@@ -174,12 +404,41 @@ public:
         }
         return static_cast<SampleType>(newSample);
     }
+    void processBlock(SampleType* samples, int numSamples) override
+    {
+        const auto phaseScale{ static_cast<SampleType>(multiplier * juce::MathConstants<double>::halfPi) };
+        const auto normalization{ static_cast<SampleType>(multiplier < 1 ? 1.0 / std::sin(multiplier * juce::MathConstants<double>::halfPi) : 1.0) };
+        for (int i = 0; i < numSamples; ++i) { samples[i] = std::sin(samples[i] * phaseScale) * normalization; }
+    }
+    void processModulatedBlock(SampleType* samples, const SampleType* gains, int numSamples) override
+    {
+        // ниже multiplier = 1 нормировка зависит от посэмплового множителя
+        const auto phaseScale{ static_cast<SampleType>(multiplier * juce::MathConstants<double>::halfPi) };
+        const auto halfPi{ juce::MathConstants<SampleType>::halfPi };
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const auto samplePhaseScale{ gains[i] * phaseScale };
+            const auto sampleValue{ std::sin(samples[i] * samplePhaseScale) };
+            samples[i] = samplePhaseScale < halfPi ? sampleValue / std::sin(samplePhaseScale) : sampleValue;
+        }
+    }
+    static SampleType getNormalization(SampleType gain) noexcept
+    {
+        const auto halfPi{ juce::MathConstants<SampleType>::halfPi };
+        return gain < static_cast<SampleType>(1) ? static_cast<SampleType>(1) / std::sin(gain * halfPi) : static_cast<SampleType>(1);
+    }
+    SampleType processSample(SampleType sample, SampleType gain, SampleType normalization) const noexcept
+    {
+        return std::sin(sample * gain * juce::MathConstants<SampleType>::halfPi) * normalization;
+    }
 };
 //==============================================================================
 template <typename SampleType>
 class LinearFoldClipper : public Clipper<SampleType>
 {
 public:
+    using Clipper<SampleType>::multiplier;
+
     LinearFoldClipper(double&& corrCoef = 1.0) : Clipper<SampleType>(std::move(corrCoef)) { }
     SampleType process(SampleType& sample) override
     {
@@ -188,11 +447,48 @@ public:
         if (multiplier < 1) { newSample = juce::jmap<double>(newSample, -multiplier, multiplier, -1.0, 1.0); }
         return static_cast<SampleType>(newSample);
     }
+    void processBlock(SampleType* samples, int numSamples) override
+    {
+        const auto gain{ static_cast<SampleType>(multiplier) };
+        const auto normalization{ static_cast<SampleType>(multiplier < 1 ? 1.0 / multiplier : 1.0) };
+        for (int i = 0; i < numSamples; ++i) { samples[i] = fold(samples[i] * gain) * normalization; }
+    }
+    void processModulatedBlock(SampleType* samples, const SampleType* gains, int numSamples) override
+    {
+        const auto gain{ static_cast<SampleType>(multiplier) };
+        const auto one{ static_cast<SampleType>(1) };
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const auto sampleGain{ gains[i] * gain };
+            const auto sampleValue{ fold(samples[i] * sampleGain) };
+            samples[i] = sampleGain < one ? sampleValue / sampleGain : sampleValue;
+        }
+    }
+    static SampleType getNormalization(SampleType gain) noexcept
+    {
+        return gain < static_cast<SampleType>(1) ? static_cast<SampleType>(1) / gain : static_cast<SampleType>(1);
+    }
+    SampleType processSample(SampleType sample, SampleType gain, SampleType normalization) const noexcept
+    {
+        return fold(sample * gain) * normalization;
+    }
 private:
+    static SampleType fold(SampleType newSample) noexcept
+    {
+        /* Замкнутая форма recursiveInversion: отражения от ±1 дают
+        треугольную волну с периодом 4 по модулю сэмпла. */
+        auto magnitude{ std::abs(newSample) };
+        if (magnitude > static_cast<SampleType>(1))
+        {
+            const auto phase{ std::fmod(magnitude + static_cast<SampleType>(1), static_cast<SampleType>(4)) };
+            magnitude = phase < static_cast<SampleType>(2) ? phase - static_cast<SampleType>(1) : static_cast<SampleType>(3) - phase;
+        }
+        return newSample < static_cast<SampleType>(0) ? -magnitude : magnitude;
+    }
     void recursiveInversion(double& sample)
     {
         bool negativeSign{ false };
-        if (std::abs(sample) >= 1)
+        if (std::abs(sample) > 1) // при >= значение ровно ±1 уходило в бесконечную рекурсию
         {
             if (sample < 0) { negativeSign = true; }
             else { negativeSign = false; }
@@ -202,12 +498,146 @@ private:
     }
 };
 //==============================================================================
+struct CurveTable;
+//==============================================================================
+class TransferCurve
+    /* Пользовательская передаточная функция. Точки задают положительную
+    половину кривой в квадрате [0, 1] x [0, 1], отрицательная получается
+    нечётным отражением. Между точками строится монотонный кубический
+    сплайн Фритча - Карлсона, который не выходит за пределы соседних точек,
+    поэтому при неубывающих точках кривая тоже не убывает. */
+{
+public:
+    TransferCurve();
+    static TransferCurve fromValueTree(const juce::ValueTree& tree);
+    juce::ValueTree toValueTree() const;
+    void setPoints(std::vector<juce::Point<float>> newPoints);
+    const std::vector<juce::Point<float>>& getPoints() const;
+    float evaluate(float x) const;
+    void compile(CurveTable& table) const;
+
+    static const juce::Identifier curveId;
+    static const juce::Identifier pointId;
+    static constexpr size_t maxNumPoints{ 16 };
+private:
+    void updateTangents();
+
+    std::vector<juce::Point<float>> points;
+    std::vector<float> tangents;
+};
+//==============================================================================
+struct CurveTable
+    /* Передаточная функция, вычисленная для |x| от 0 до 1 включительно,
+    и сама кривая для точного вычисления в офлайн-профиле качества. */
+{
+    std::array<float, CURVE_TABLE_SIZE + 1> values{};
+    TransferCurve curve;
+};
+//==============================================================================
+class SharedResources
+    /* Неизменяемые ресурсы, общие для всех экземпляров плагина в процессе:
+    гарнитура, декодированный логотип и таблица кривой по умолчанию.
+    Раздаётся через juce::SharedResourcePointer, создаётся с первым
+    экземпляром и удаляется с последним. Гарнитура и логотип нужны только
+    интерфейсу и создаются при первом запросе, поэтому сканирование
+    плагина хостом их не декодирует. */
+{
+public:
+    SharedResources();
+    juce::Typeface::Ptr getTypeface();
+    juce::Image getLogo();
+    const CurveTable& getDefaultCurveTable() const noexcept;
+private:
+    juce::CriticalSection lock;
+    juce::Typeface::Ptr typeface;
+    juce::Image logo; // пиксели juce::Image разделяются между копиями
+    CurveTable defaultCurveTable;
+};
+//==============================================================================
+template <typename SampleType>
+class CustomClipper : public Clipper<SampleType>
+    /* Клиппер с пользовательской кривой. Кривая компилируется вне аудиопотока
+    в таблицу, поэтому сэмпл стоит одного чтения с линейной интерполяцией
+    независимо от сложности сплайна. Таблицу подставляет processBlock,
+    до этого используется кривая по умолчанию. */
+{
+public:
+    using Clipper<SampleType>::multiplier;
+    using Clipper<SampleType>::correctionCoefficient;
+
+    CustomClipper(double&& corrCoef = 1.0) : Clipper<SampleType>(std::move(corrCoef)) { }
+    void setTable(const CurveTable* newTable) noexcept { table = newTable != nullptr ? newTable : &resources->getDefaultCurveTable(); }
+    void setAnalytic(bool shouldBeAnalytic) noexcept { analytic = shouldBeAnalytic; } // сплайн вместо таблицы, для офлайн-рендера
+    SampleType process(SampleType& sample) override
+    {
+        return lookup(sample * static_cast<SampleType>(multiplier), table->values.data());
+    }
+    void processBlock(SampleType* samples, int numSamples) override
+    {
+        const auto gain{ static_cast<SampleType>(multiplier) };
+        if (analytic)
+        {
+            for (int i = 0; i < numSamples; ++i) { samples[i] = evaluate(samples[i] * gain, table->curve); }
+            return;
+        }
+        // цикл без ветвлений, кроме выбора знака, чтобы его мог векторизовать компилятор
+        const auto* values{ table->values.data() };
+        for (int i = 0; i < numSamples; ++i) { samples[i] = lookup(samples[i] * gain, values); }
+    }
+    void processModulatedBlock(SampleType* samples, const SampleType* gains, int numSamples) override
+    {
+        const auto gain{ static_cast<SampleType>(multiplier) };
+        if (analytic)
+        {
+            for (int i = 0; i < numSamples; ++i) { samples[i] = evaluate(samples[i] * gains[i] * gain, table->curve); }
+            return;
+        }
+        const auto* values{ table->values.data() };
+        for (int i = 0; i < numSamples; ++i) { samples[i] = lookup(samples[i] * gains[i] * gain, values); }
+    }
+    static SampleType getNormalization(SampleType) noexcept { return static_cast<SampleType>(1); }
+    SampleType processSample(SampleType sample, SampleType gain, SampleType) const noexcept
+    {
+        return analytic ? evaluate(sample * gain, table->curve) : lookup(sample * gain, table->values.data());
+    }
+private:
+    static SampleType evaluate(SampleType sample, const TransferCurve& curve) noexcept
+    {
+        const auto one{ static_cast<SampleType>(1) };
+        const auto magnitude{ std::abs(sample) };
+        const auto value{ static_cast<SampleType>(curve.evaluate(static_cast<float>(magnitude < one ? magnitude : one))) };
+        return sample < static_cast<SampleType>(0) ? -value : value;
+    }
+    static SampleType lookup(SampleType sample, const float* values) noexcept
+    {
+        const auto one{ static_cast<SampleType>(1) };
+        const auto magnitude{ std::abs(sample) };
+        // NaN тоже уходит в конец таблицы
+        const auto position{ (magnitude < one ? magnitude : one) * static_cast<SampleType>(CURVE_TABLE_SIZE) };
+        const auto index{ juce::jmin(static_cast<int>(position), CURVE_TABLE_SIZE - 1) };
+        const auto fraction{ position - static_cast<SampleType>(index) };
+        const auto value{ static_cast<SampleType>(values[index])
+                          + fraction * static_cast<SampleType>(values[index + 1] - values[index]) };
+        return sample < static_cast<SampleType>(0) ? -value : value;
+    }
+    virtual const double& getOffset() const override { return correctionOffset; }
+
+    double correctionOffset{ correctionCoefficient - 1.0 }; // как у HardClipper: при Clip = 1 кривая применяется как нарисована
+    juce::SharedResourcePointer<SharedResources> resources; // таблица по умолчанию одна на процесс
+    const CurveTable* table{ &resources->getDefaultCurveTable() };
+    bool analytic{ false };
+};
+//==============================================================================
 class ClipHolder
 {
 public:
     ClipHolder();
     void setClipper(int newClipper);
     Clipper<float>* getClipper() const;
+    Clipper<float>* getClipper(int clipperType) const;
+    CustomClipper<float>* getCustomClipper() const;
+    float getNormalization(float gain) const noexcept;
+    float processSample(float sample, float gain, float normalization) const noexcept;
 private:
     std::vector<Clipper<float>*> clippers;
     int currentClipper;
@@ -216,6 +646,241 @@ private:
     std::shared_ptr<FoldbackClipper<float>> foldbackClipper{ new FoldbackClipper<float>(FOLDBACK_COEF) };
     std::shared_ptr<SineFoldClipper<float>> sineFoldClipper{ new SineFoldClipper<float>(SINEFOLD_COEF) };
     std::shared_ptr<LinearFoldClipper<float>> linearFoldClipper{ new LinearFoldClipper<float>(LINEARFOLD_COEF) };
+    std::shared_ptr<CustomClipper<float>> customClipper{ new CustomClipper<float>(CUSTOM_COEF) };
+};
+//==============================================================================
+struct ClipStage
+    /* Дополнительная ступень каскада. У каждой ступени свой ClipHolder,
+    чтобы ступени одного типа не делили multiplier. Тип читается аудиопотоком
+    из APVTS в начале блока, Clip и усиление сглаживаются. Посэмпловые
+    множители, нормировки и усиления считаются один раз на сегмент
+    и общие для всех каналов. */
+{
+    ClipHolder clipHolder;
+    std::atomic<float>* typeParameter{ nullptr };
+    std::atomic<float>* clipParameter{ nullptr };
+    std::atomic<float>* gainParameter{ nullptr };
+    juce::SmoothedValue<float> clip;
+    juce::SmoothedValue<float, juce::ValueSmoothingTypes::Multiplicative> gain;
+    std::vector<float> multipliers;
+    std::vector<float> normalizations;
+    std::vector<float> gains;
+};
+//==============================================================================
+class DryDelay
+    /* Сухая ветвь параллельного клиппинга. Входной сигнал копируется
+    в заранее выделенный буфер через кольцевую задержку, равную латентности
+    стадий до точки смешивания, чтобы сухой и обработанный сигналы
+    совпадали по фазе. При нулевой задержке это простое копирование. */
+{
+public:
+    void prepare(int numChannels, int maxBlockSize, int maxDelay);
+    void reset();
+    void setDelay(int newDelay) noexcept;
+    int getDelay() const noexcept;
+    void capture(const juce::AudioBuffer<float>& input) noexcept;
+    const float* getReadPointer(int channel) const noexcept;
+private:
+    juce::AudioBuffer<float> delayLine;
+    juce::AudioBuffer<float> dryBuffer;
+    int writePosition{ 0 };
+    int delay{ 0 };
+};
+//==============================================================================
+class EnvelopeFollower
+    /* Пиковый детектор сайдчейна для динамического драйва. Блок считается
+    в два прохода: максимум модуля по каналам векторными операциями,
+    затем рекурсия атаки/спада без ветвлений. Результат пишется в массив
+    на весь блок, который потом превращается в посэмпловые множители. */
+{
+public:
+    void prepare(double newSampleRate);
+    void reset();
+    void setAttackInMs(float newAttackInMs) noexcept;
+    void setReleaseInMs(float newReleaseInMs) noexcept;
+    void process(const juce::AudioBuffer<float>& sidechain, float* envelope, int numSamples) noexcept;
+private:
+    float getCoefficient(float timeInMs) const noexcept;
+
+    double sampleRate{ 44100.0 };
+    float attackInMs{ 5.0f };
+    float releaseInMs{ 100.0f };
+    float attackCoefficient{ 1.0f };
+    float releaseCoefficient{ 1.0f };
+    float state{ 0.0f };
+};
+//==============================================================================
+class TransientDetector
+    /* Детектор транзиентов из двух огибающих: быстрая успевает за атакой,
+    медленная отстаёт. Вес транзиента растёт с разницей между ними
+    и равен 1, когда быстрая вдвое выше медленной. Обе огибающие и вес
+    считаются за один проход по блоку, вес затем превращается
+    в посэмпловые множители для processModulatedBlock. */
+{
+public:
+    void prepare(double newSampleRate);
+    void reset();
+    void process(const juce::AudioBuffer<float>& buffer, float* weights, int numSamples) noexcept;
+private:
+    struct Coefficients { float attack{ 1.0f }, release{ 1.0f }; };
+    Coefficients makeCoefficients(float attackInMs, float releaseInMs) const noexcept;
+
+    double sampleRate{ 44100.0 };
+    Coefficients fast, slow;
+    float fastState{ 0.0f };
+    float slowState{ 0.0f };
+};
+//==============================================================================
+class ModulationEngine
+    /* Источник модуляции, синхронизированный с AudioPlayHead: LFO одной
+    из форм или пошаговый секвенсор. Значения считаются раз на кусок
+    блока хоста с шагом MOD_CONTROL_INTERVAL в заранее выделенный буфер и общие для
+    всех каналов. До звуковой частоты они интерполируются только в render,
+    который вызывают потребители: отображение значения (например, перевод
+    децибел в усиление) тоже выполняется с управляющей частотой. Без
+    транспорта хоста LFO идёт со своим темпом от последней позиции. */
+{
+public:
+    enum Target { off, clip, inputGain, mix };
+    enum Shape { sine, triangle, saw, square, steps };
+
+    void prepare(double newSampleRate, int maxBlockSize);
+    void reset();
+    void setShape(int newShape) noexcept;
+    void setRate(int newRate) noexcept;
+    void setDepth(float newDepth) noexcept;
+    void setStep(int step, float value) noexcept;
+    void setControlInterval(int newControlInterval) noexcept;
+    void generate(juce::AudioPlayHead* playHead, int startSample, int numSamples) noexcept;
+
+    template <typename MappingFunction>
+    void render(int startSample, int numSamples, float* destination, MappingFunction map) const noexcept
+    {
+        // линейная интерполяция между отображёнными управляющими точками
+        for (int i = 0; i < numSamples;)
+        {
+            const auto position{ startSample + i };
+            const auto index{ static_cast<size_t>(position / controlInterval) };
+            const auto offset{ position % controlInterval };
+            const auto count{ juce::jmin(controlInterval - offset, numSamples - i) };
+            const float from{ map(controlValues[index]) };
+            const float increment{ (map(controlValues[index + 1]) - from) / static_cast<float>(controlInterval) };
+            auto value{ from + increment * offset };
+            for (int j = 0; j < count; ++j, value += increment) { destination[i + j] = value; }
+            i += count;
+        }
+    }
+
+    static const juce::StringArray targetNames;
+    static const juce::StringArray shapeNames;
+    static const juce::StringArray rateNames;
+private:
+    float getShapeValue(double cycles) const noexcept;
+
+    std::vector<float> controlValues; // от -depth до depth, выделен под интервал в 1 отсчёт
+    double sampleRate{ 44100.0 };
+    double freeRunningPpq{ 0.0 };
+    double bpm{ 120.0 };
+    int maxNumSamples{ 0 };
+    int controlInterval{ MOD_CONTROL_INTERVAL };
+    int shape{ sine };
+    int rate{ 2 };
+    float depth{ 0.5f };
+    std::array<float, MOD_NUM_STEPS> stepValues{};
+};
+//==============================================================================
+class EmphasisFilter
+    /* Пара пред- и деэмфазиса вокруг клиппера: наклон АЧХ полкой с центром
+    на заданной частоте перед клиппером и точно обратный фильтр после него.
+    Полка минимально-фазовая, поэтому обратный биквад получается
+    перестановкой числителя и знаменателя. Оба фильтра в транспонированной
+    второй прямой форме, состояние на канал выделяется в prepare.
+    Наклон и частота сглаживаются: setTilt раз на сегмент рассчитывает
+    коэффициенты на каждые EMPHASIS_UPDATE_INTERVAL отсчётов, и все каналы
+    проходят по одной и той же траектории без ступенек на границах блоков. */
+{
+public:
+    void prepare(double newSampleRate, int numChannels, int maxBlockSize);
+    void reset();
+    void setTilt(float newTiltInDb, float newFrequency, int numSamples) noexcept;
+    bool isActive() const noexcept;
+    void processPre(int channel, float* data, int numSamples) noexcept;
+    void processPost(int channel, float* data, int numSamples) noexcept;
+private:
+    struct Coefficients { float b0{ 1.0f }, b1{ 0.0f }, b2{ 0.0f }, a1{ 0.0f }, a2{ 0.0f }; };
+    typedef std::array<float, 2> State;
+    void process(const std::vector<Coefficients>& coefficients, State& state, float* data, int numSamples) const noexcept;
+    static void process(const Coefficients& coefficients, State& state, float* data, int numSamples) noexcept;
+    void updateCoefficients(size_t index, float tiltInDb, float tiltFrequency) noexcept;
+
+    std::vector<Coefficients> pre, post; // по набору на подблок сегмента, в покое используется первый
+    int numCoefficients{ 0 };
+    bool ramping{ false };
+    std::vector<State> preStates, postStates;
+    double sampleRate{ 44100.0 };
+    juce::SmoothedValue<float> tilt;
+    juce::SmoothedValue<float, juce::ValueSmoothingTypes::Multiplicative> frequency{ 1000.0f };
+};
+//==============================================================================
+class TruePeakLimiter
+    /* Лимитер с заглядыванием вперёд на выходе цепи. Пики ищутся между
+    отсчётами четырёхкратной интерполяцией, максимум по окну заглядывания
+    считается монотонной очередью за O(1) на отсчёт. Удержанное усиление
+    сглаживается скользящим средним длиной в окно, поэтому к приходу пика
+    в задержанный сигнал усиление уже не выше нужного и без ступенек.
+    Каналы связаны: усиление общее по максимальному пику.
+    Выключенный лимитер только задерживает сигнал на ту же латентность,
+    чтобы заявленная хосту задержка не менялась. */
+{
+public:
+    void prepare(double newSampleRate, int numChannels);
+    void reset();
+    void resume() noexcept;
+    void setCeilingInDb(float newCeilingInDb) noexcept;
+    void setReleaseInMs(float newReleaseInMs) noexcept;
+    void setQuality(int newOversampling, int newInterpolationTaps) noexcept;
+    int getLatencyInSamples() const noexcept;
+    void process(juce::AudioBuffer<float>& buffer, bool applyGain) noexcept;
+    void delay(juce::AudioBuffer<float>& buffer) noexcept;
+
+    static constexpr int maxOversampling{ 8 };
+    static constexpr int maxInterpolationTaps{ 16 };
+private:
+    float detectPeak(size_t channel, float sample) noexcept;
+    float pushPeak(float peak) noexcept;
+    void resetDetector() noexcept;
+    void updateKernels() noexcept;
+
+    /* Окно истории рассчитано на самое длинное ядро, короткое ядро стоит
+    в его середине, поэтому задержка детектора и латентность
+    от качества не зависят. */
+    static constexpr int detectorDelay{ maxInterpolationTaps / 2 }; // пик оценивается около отсчёта, пришедшего 8 отсчётов назад
+    std::array<std::array<float, maxInterpolationTaps>, maxOversampling - 1> interpolationKernels{};
+    std::vector<std::array<float, maxInterpolationTaps>> history;
+    int oversampling{ 4 };
+    int interpolationTaps{ 8 };
+    int firstTap{ detectorDelay - 4 };
+
+    juce::AudioBuffer<float> delayLine;
+    int delayWritePosition{ 0 };
+    int lookahead{ 1 };
+
+    // монотонная очередь: пики по убыванию и моменты их прихода
+    std::vector<float> queuePeaks;
+    std::vector<juce::int64> queueTimes;
+    int queueHead{ 0 };
+    int queueSize{ 0 };
+    juce::int64 sampleCounter{ 0 };
+
+    std::vector<float> smoothingHistory;
+    double smoothingSum{ 0.0 };
+    int smoothingPosition{ 0 };
+
+    double sampleRate{ 44100.0 };
+    float ceiling{ 1.0f };
+    float releaseCoefficient{ 0.0f };
+    float releaseInMs{ 50.0f };
+    float envelope{ 1.0f };
 };
 //==============================================================================
 class GainController
@@ -235,10 +900,424 @@ private:
     bool bypassed{ false };
 };
 //==============================================================================
-class PresetManager : public juce::ValueTree::Listener
+inline juce::uint64 readCycleCounter() noexcept
+{
+   #if JUCE_INTEL
+    return static_cast<juce::uint64>(__rdtsc());
+   #else
+    return static_cast<juce::uint64>(juce::Time::getHighResolutionTicks());
+   #endif
+}
+
+enum LoadStage { inputGainStage, clippingStage, outputGainStage, limiterStage, analysisStage, numLoadStages };
+
+struct LoadStatistics
+    // Все значения - доли бюджета реального времени блока, 1.0 = 100%
+{
+    double budgetMs{ 0.0 };
+    double average{ 0.0 };
+    double p99{ 0.0 };
+    double worst{ 0.0 };
+    std::array<double, numLoadStages> stageAverage{};
+    juce::uint32 numBlocks{ 0 };
+    int qualityLevel{ 0 }; // ступень регулятора нагрузки, 0 - полное качество
+};
+//==============================================================================
+class ProcessLoadMeter
+    /* Измеряет время processBlock относительно бюджета реального времени
+    (размер блока / частота дискретизации). Аудиопоток только пишет атомарные
+    счётчики, а этапы обработки размечаются счётчиком циклов процессора.
+    Две гистограммы сменяют друг друга каждые ~2 секунды - скользящее окно. */
 {
 public:
-    PresetManager(APVTS& _apvts, juce::ValueTree& _defaultTree);
+    void prepare(double newSampleRate, int samplesPerBlock);
+    void beginBlock() noexcept;
+    void markStage(LoadStage stage) noexcept;
+    void endBlock(int numSamples) noexcept;
+    LoadStatistics getStatistics() const;
+    double getLastLoad() const noexcept;
+    void requestReset() noexcept; // статистику сбрасывает аудиопоток в начале следующего блока
+private:
+    void clear() noexcept;
+
+    static constexpr int numBins{ 200 }; // шаг 1% бюджета, последний бин - переполнение
+    static constexpr double smoothing{ 0.05 };
+
+    std::array<std::array<std::atomic<juce::uint32>, numBins>, 2> histograms{};
+    std::atomic<int> activeHistogram{ 0 };
+    int blocksInHistogram{ 0 };
+    int blocksPerHistogram{ 1 };
+    double sampleRate{ 44100.0 };
+    double ticksPerSecond{ 1.0 };
+    juce::int64 blockStartTicks{ 0 };
+    juce::uint64 blockStartCycles{ 0 };
+    juce::uint64 stageStartCycles{ 0 };
+    std::array<juce::uint64, numLoadStages> stageCycles{};
+    double lastLoad{ 0.0 }; // только для аудиопотока
+    std::atomic<double> budgetSeconds{ 0.0 };
+    std::atomic<double> averageLoad{ 0.0 };
+    std::atomic<double> worstLoad{ 0.0 };
+    std::array<std::atomic<double>, numLoadStages> stageLoad{};
+    std::atomic<juce::uint32> numBlocks{ 0 };
+    std::atomic<bool> resetRequested{ false };
+};
+//==============================================================================
+struct TraceEvent
+{
+    const char* name{ nullptr };
+    juce::int64 startTicks{ 0 };
+    juce::int64 endTicks{ 0 };
+};
+//==============================================================================
+class AnalysisThread : public juce::TimeSliceThread
+    /* Один фоновый поток анализа на все экземпляры плагина в процессе,
+    раздаётся через SharedResourcePointer. */
+{
+public:
+    AnalysisThread() : juce::TimeSliceThread("Destruction analysis") { startThread(); }
+    ~AnalysisThread() override { stopThread(1000); }
+};
+//==============================================================================
+struct LoudnessTap
+{
+    double inputEnergy{ 0.0 };
+    double outputEnergy{ 0.0 };
+    int numSamples{ 0 };
+};
+
+class LoudnessMatcher : public juce::TimeSliceClient
+    /* Автокомпенсация громкости. Аудиопоток отдаёт через Fifo только суммы
+    квадратов до и после клиппинга за блок, фоновый поток интегрирует их
+    с постоянной времени в несколько секунд и публикует готовую
+    компенсацию в децибелах. Тишина ниже порога в интеграл не попадает. */
+{
+public:
+    void prepare(double newSampleRate);
+    void pushTap(double inputEnergy, double outputEnergy, int numSamples) noexcept;
+    float getCompensationInDb() const noexcept;
+    int useTimeSlice() override;
+private:
+    Fifo<LoudnessTap, 512> taps;
+    std::atomic<double> sampleRate{ 44100.0 };
+    std::atomic<bool> resetRequested{ true };
+    std::atomic<float> compensationInDb{ 0.0f };
+    // только фоновый поток
+    double inputIntegral{ 0.0 };
+    double outputIntegral{ 0.0 };
+
+    static constexpr double integrationSeconds{ 3.0 };
+    static constexpr double gateEnergy{ 1.0e-7 }; // -70 dBFS
+    static constexpr float maxCompensationInDb{ 24.0f };
+};
+//==============================================================================
+enum SpectrumTap { preClipTap, postClipTap, numSpectrumTaps };
+
+class SpectrumAnalyzer : public juce::TimeSliceClient
+    /* Анализатор спектра до и после клиппинга. Аудиопоток только сводит
+    каналы в моно и пишет отсчёты в lock-free кольцо, и только пока
+    анализатор кто-то показывает. Фоновый поток считает FFT с окном Ханна
+    и перекрытием, сводит бины в логарифмические полосы, применяет
+    баллистику и удержание пиков и публикует готовые уровни в дБ. */
+{
+public:
+    using Spectrum = std::array<float, SPECTRUM_NUM_BINS>;
+
+    SpectrumAnalyzer();
+    void prepare(double newSampleRate);
+    void setActive(bool shouldBeActive) noexcept;
+    bool isActive() const noexcept;
+    void push(int tap, const juce::AudioBuffer<float>& buffer) noexcept;
+    void getSpectrum(int tap, Spectrum& levels, Spectrum& peaks) const noexcept;
+    juce::uint32 getVersion() const noexcept; // растёт с каждой опубликованной порцией
+    float getMaxFrequency() const noexcept;
+    int useTimeSlice() override;
+
+    static constexpr float minFrequency{ 20.0f };
+    static constexpr float minLevelInDb{ -96.0f };
+private:
+    static constexpr int fftSize{ 1 << SPECTRUM_FFT_ORDER };
+    static constexpr int hopSize{ fftSize / SPECTRUM_OVERLAP };
+    static constexpr int ringSize{ 8 * fftSize };
+    static constexpr double attackSeconds{ 0.01 };
+    static constexpr double releaseSeconds{ 0.3 };
+    static constexpr float peakFallInDbPerSecond{ 20.0f };
+
+    struct Channel
+    {
+        juce::AbstractFifo fifo{ ringSize };
+        std::vector<float> ring;
+        std::array<std::atomic<float>, SPECTRUM_NUM_BINS> levels;
+        std::array<std::atomic<float>, SPECTRUM_NUM_BINS> peaks;
+        // только фоновый поток
+        std::vector<float> frame;
+        Spectrum smoothed{};
+        Spectrum held{};
+        std::array<int, SPECTRUM_NUM_BINS> holdFrames{};
+    };
+    void reset();
+    void analyse(Channel& channel) noexcept;
+
+    std::array<Channel, numSpectrumTaps> channels;
+    std::atomic<bool> active{ false };
+    std::atomic<double> sampleRate{ 44100.0 };
+    std::atomic<bool> resetRequested{ true };
+    std::atomic<juce::uint32> version{ 0 };
+    // только фоновый поток
+    juce::dsp::FFT fft{ SPECTRUM_FFT_ORDER };
+    std::vector<float> window;
+    std::vector<float> fftData;
+    std::array<float, SPECTRUM_NUM_BINS + 1> binEdges{}; // границы полос в индексах бинов FFT
+    float attack{ 1.0f };
+    float release{ 1.0f };
+    int peakHoldFrames{ 0 };
+    float peakFall{ 0.0f };
+};
+//==============================================================================
+struct HarmonicReport
+    // Уровни гармоник и алиасинга - в дБ относительно основного тона (dBc)
+{
+    int clipperType{ 0 };
+    double clip{ 1.0 };
+    double fundamentalInDb{ 0.0 }; // dBFS
+    double thd{ 0.0 }; // доля основного тона: гармоники со 2-й по HARMONIC_MAX_ORDER
+    double aliasInDb{ 0.0 }; // всё, что не попало на DC и гармонические бины
+    std::array<double, HARMONIC_MAX_ORDER - 1> harmonicsInDb{}; // со 2-й гармоники
+};
+//==============================================================================
+class HarmonicAnalyzer
+    /* Гармонический анализ клиппера на тестовом тоне. Частота тона кратна
+    шагу FFT, поэтому окно не нужно и утечки нет: каждая гармоника ниже
+    Найквиста и каждая отражённая гармоника выше него попадают ровно
+    в свой бин. Клипперы без памяти, прогрев не нужен. Каждому потоку
+    нужен свой экземпляр. */
+{
+public:
+    HarmonicReport analyse(int clipperType, double clip, const CurveTable* customTable = nullptr);
+    double getMultiplierFor(int clipperType, double clip) const; // коэффициенты клипперов не меняются, вызов безопасен из любого потока
+    static double getTestFrequency() noexcept;
+private:
+    static constexpr int fftSize{ 1 << HARMONIC_FFT_ORDER };
+
+    juce::dsp::FFT fft{ HARMONIC_FFT_ORDER };
+    ClipHolder clipHolder;
+    std::vector<float> data;
+};
+//==============================================================================
+class HarmonicAnalysisService : public juce::TimeSliceClient
+    /* Анализ искажений для интерфейса. Запросы приходят с потока сообщений,
+    расчёт идёт на общем фоновом потоке анализа, результаты кэшируются
+    по ключу (тип клиппера, multiplier). Смена пользовательской кривой
+    сбрасывает результаты Custom и увеличивает поколение кэша. */
+{
+public:
+    void request(int clipperType, double clip);
+    bool getReport(int clipperType, double clip, HarmonicReport& report) const;
+    void setCustomCurve(const TransferCurve& curve);
+    juce::uint32 getGeneration() const noexcept;
+    int useTimeSlice() override;
+private:
+    using Key = std::pair<int, juce::int64>;
+    Key makeKey(int clipperType, double clip) const;
+
+    static constexpr size_t maxCacheSize{ 1024 };
+
+    juce::CriticalSection lock; // аудиопоток сюда не обращается
+    std::map<Key, HarmonicReport> cache;
+    std::vector<std::pair<int, double>> pending;
+    std::unique_ptr<TransferCurve> pendingCurve;
+    std::atomic<juce::uint32> generation{ 0 };
+    // только фоновый поток
+    HarmonicAnalyzer analyzer;
+    CurveTable customTable;
+    bool hasCustomTable{ false };
+};
+//==============================================================================
+class Tracer : private juce::Thread
+    /* Общий на процесс сборщик событий в формате Chrome/Perfetto trace JSON.
+    Каждый поток пишет события фиксированного размера в собственный
+    lock-free буфер из заранее выделенного пула, фоновый поток периодически
+    сбрасывает их в файл. Буфер завершившегося потока возвращается в пул
+    после сброса его событий. Пока запись не запущена, TraceScope стоит одну
+    атомарную загрузку. Используется через juce::SharedResourcePointer. */
+{
+public:
+    Tracer();
+    ~Tracer() override;
+    bool start(const juce::File& file);
+    void stop();
+    bool isEnabled() const noexcept { return enabled.load(std::memory_order_relaxed); }
+    void addEvent(const char* name, juce::int64 startTicks, juce::int64 endTicks) noexcept;
+    static Tracer* getActive() noexcept { return activeTracer.load(std::memory_order_acquire); }
+private:
+    struct ThreadBuffer
+    {
+        std::atomic<juce::Thread::ThreadID> owner{ nullptr };
+        std::atomic<bool> active{ false }; // поля ниже заполнены владельцем
+        std::atomic<bool> released{ false }; // владелец завершился, буфер освободит поток записи
+        int traceThreadId{ 0 }; // tid в файле, новый для каждого владельца буфера
+        bool isMessageThread{ false };
+        bool named{ false };
+        Fifo<TraceEvent, 4096> events;
+    };
+    struct ThreadSlot
+        // номер буфера, закреплённого за текущим потоком; деструктор срабатывает при выходе потока
+    {
+        ~ThreadSlot();
+        int index{ -1 };
+    };
+    static constexpr int maxThreads{ 16 };
+    using BufferPool = std::array<ThreadBuffer, maxThreads>;
+
+    void run() override;
+    void flush();
+    int claimBuffer(BufferPool& pool, juce::Thread::ThreadID threadId) noexcept;
+    void releaseBuffer(int index) noexcept;
+    static ThreadSlot& getThreadSlot() noexcept
+    {
+        static thread_local ThreadSlot slot;
+        return slot;
+    }
+
+    static std::atomic<Tracer*> activeTracer;
+    std::unique_ptr<BufferPool> bufferStorage;
+    std::atomic<BufferPool*> buffers{ nullptr }; // читается потоками с acquire, публикуется в start
+    std::atomic<int> nextTraceThreadId{ 0 };
+    std::unique_ptr<juce::FileOutputStream> stream;
+    std::atomic<bool> enabled{ false };
+    std::atomic<juce::uint32> droppedEvents{ 0 };
+    bool firstEvent{ true };
+    double ticksToMicroseconds{ 1.0 };
+    juce::int64 originTicks{ 0 };
+};
+//==============================================================================
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* _name) noexcept : name(_name), tracer(Tracer::getActive())
+    {
+        if (tracer != nullptr && tracer->isEnabled()) { startTicks = juce::Time::getHighResolutionTicks(); }
+    }
+    ~TraceScope()
+    {
+        if (startTicks != 0) { tracer->addEvent(name, startTicks, juce::Time::getHighResolutionTicks()); }
+    }
+private:
+    const char* name;
+    Tracer* tracer;
+    juce::int64 startTicks{ 0 };
+};
+
+#if TRACING
+    #define TRACE_SCOPE(name) TraceScope JUCE_JOIN_MACRO(traceScope_, __LINE__){ name }
+#else
+    #define TRACE_SCOPE(name)
+#endif
+//==============================================================================
+class RealtimeScope
+    /* Помечает текущий поток как находящийся внутри processBlock.
+    Сама по себе ничего не проверяет: перехватчики выделения памяти
+    и мьютексов устанавливает утилита DestructionBenchmark (--rt-check)
+    и спрашивает у isActive, пришёлся ли вызов на аудиопоток. */
+{
+public:
+    RealtimeScope() noexcept { ++depth(); }
+    ~RealtimeScope() noexcept { --depth(); }
+    static bool isActive() noexcept { return depth() > 0; }
+private:
+    static int& depth() noexcept
+    {
+        static thread_local int value{ 0 };
+        return value;
+    }
+};
+
+#if RT_SAFETY_CHECK
+    #define REALTIME_SCOPE RealtimeScope JUCE_JOIN_MACRO(realtimeScope_, __LINE__)
+#else
+    #define REALTIME_SCOPE
+#endif
+//==============================================================================
+struct QualityProfile
+    /* Профиль качества. При воспроизведении используется дешёвый, при
+    офлайн-рендере (isNonRealtime) - лучший. Все буферы выделяются
+    в prepareToPlay под лучший профиль, поэтому переключение не выделяет
+    память, а латентность в обоих профилях одинакова. */
+{
+    static QualityProfile realtime() noexcept;
+    static QualityProfile offline() noexcept;
+
+    int limiterOversampling{ 4 };
+    int limiterInterpolationTaps{ 8 };
+    bool analyticCurves{ false }; // Custom: сплайн вместо таблицы
+    int modulationInterval{ MOD_CONTROL_INTERVAL };
+    int minSubBlockSize{ MIN_SUBBLOCK_SIZE };
+    int analysisInterval{ 1 }; // в анализ громкости уходит каждый N-й кусок
+    bool isOffline{ false };
+};
+//==============================================================================
+class QualityGovernor
+    /* Регулятор нагрузки для больших живых сессий. Следит за долей бюджета
+    блока, которую занимает processBlock, и при нехватке времени понижает
+    качество по ступеням, а при появлении запаса возвращает его. Пороги
+    разнесены, после каждого переключения выдерживается пауза, а повышение
+    требует нескольких секунд запаса подряд, поэтому ступени не качаются.
+    Пропуск дедлайна понижает ступень сразу. */
+{
+public:
+    void prepare(double newSampleRate);
+    void reset() noexcept;
+    bool update(double load, int numSamples) noexcept; // true, если ступень сменилась
+    int getLevel() const noexcept;
+    static QualityProfile getProfile(int qualityLevel) noexcept;
+
+    static constexpr int numLevels{ 3 };
+private:
+    static constexpr double smoothing{ 0.1 };
+
+    double sampleRate{ 44100.0 };
+    double averageLoad{ 0.0 };
+    std::atomic<int> level{ 0 }; // читается интерфейсом
+    int holdSamples{ 0 };
+    int recoverySamples{ 0 };
+};
+//==============================================================================
+struct ParameterSnapshot
+    /* Снимок значений всех параметров, собранный заранее вне аудиопотока.
+    Передаётся в processBlock через Fifo и применяется целиком в начале
+    блока, поэтому смена пресета не приводит к частичному состоянию. */
+{
+    static ParameterSnapshot fromValueTree(const juce::ValueTree& tree);
+    static ParameterSnapshot interpolate(const ParameterSnapshot& a, const ParameterSnapshot& b, double proportion);
+
+    double inputGainInDb{ 0.0 };
+    double outputGainInDb{ 0.0 };
+    double clip{ 1.0 };
+    int clipperType{ hard - 1 }; // индекс в списке Clipper Type, а не значение ClipperType
+    bool bypassed{ false };
+    bool linked{ true };
+    bool autoGain{ false }; // при автокомпенсации Link не зеркалит Output Gain
+};
+
+typedef Fifo<ParameterSnapshot, 16> SnapshotFifo;
+//==============================================================================
+struct MorphEndpoints
+    /* Пара заранее декодированных пресетов A и B для морфинга.
+    Аудиопоток только интерполирует числа между ними. */
+{
+    ParameterSnapshot a;
+    ParameterSnapshot b;
+    bool active{ false };
+};
+
+typedef Fifo<MorphEndpoints, 4> MorphFifo;
+//==============================================================================
+class PresetManager : public juce::ValueTree::Listener, public juce::ChangeBroadcaster
+    /* Чтение, запись и удаление файлов пресетов выполняются в фоновом потоке.
+    Готовое дерево применяется на message thread одним вызовом replaceState,
+    после чего рассылается сообщение об изменении для обновления редакторов. */
+{
+public:
+    PresetManager(APVTS& _apvts, juce::ValueTree& _defaultTree, SnapshotFifo& _snapshots, MorphFifo& _morphs);
     ~PresetManager();
     void newPreset();
     void savePreset(const juce::String& presetName);
@@ -247,6 +1326,9 @@ public:
     void updatePresetList();
     int nextPreset();
     int previousPreset();
+    void setMorphEndpoint(int slot, const juce::String& presetName);
+    void clearMorph();
+    juce::String getMorphEndpointName(int slot) const;
     void valueTreeRedirected(juce::ValueTree& changedTree) override;
 
     APVTS& apvts;
@@ -255,10 +1337,25 @@ public:
     static const juce::String extention;
     juce::Value currentPreset;
     juce::StringArray presetList;
-    const int presetListIdOffset{ 4 };
+    const int presetListIdOffset{ 7 };
+private:
+    static juce::StringArray scanPresetDirectory();
+    void applyState(const juce::ValueTree& newState, const ParameterSnapshot& snapshot, const juce::String& presetName);
+    void applyMorphEndpoint(int slot, const ParameterSnapshot& snapshot, const juce::String& presetName);
+
+    SnapshotFifo& snapshots;
+    MorphFifo& morphs;
+    juce::String pendingPreset; // загружается в фоне, от него считают nextPreset/previousPreset
+    MorphEndpoints morphEndpoints;
+    std::array<juce::String, 2> morphNames;
+    juce::ThreadPool worker{ 1 };
+
+    JUCE_DECLARE_WEAK_REFERENCEABLE(PresetManager)
 };
 //==============================================================================
-class DestructionAudioProcessor  : public juce::AudioProcessor
+class DestructionAudioProcessor  : public juce::AudioProcessor,
+                                    private juce::ValueTree::Listener,
+                                    private juce::Timer
                             #if JucePlugin_Enable_ARA
                              , public juce::AudioProcessorARAExtension
                             #endif
@@ -297,26 +1394,119 @@ public:
     const juce::String getProgramName (int index) override;
     void changeProgramName (int index, const juce::String& newName) override;
     void updatePluginState();
+    ParameterSnapshot makeParameterSnapshot() const noexcept;
+    void applyParameterSnapshot(const ParameterSnapshot& snapshot);
     //==============================================================================
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
+    void getLegacyStateInformation(juce::MemoryBlock& destData);
+    //==============================================================================
+    LoadStatistics getLoadStatistics() const;
+    void resetLoadStatistics();
+    //==============================================================================
+    TransferCurve getCustomCurve() const;
+    void setCustomCurve(const TransferCurve& curve);
 
     //==============================================================================
     PresetManager& getPresetManager();
+    SpectrumAnalyzer& getSpectrumAnalyzer();
+    HarmonicAnalysisService& getHarmonicAnalysis();
     APVTS::ParameterLayout createParameterLayout();
     APVTS apvts;
     juce::ValueTree defaultTree;
 
-    Fifo<juce::AudioBuffer<float>, 256> fifo;
+    SnapshotFifo presetSnapshots; // пресеты, состояние хоста и правки из редактора
+    MorphFifo morphFifo;
     GainController gainController;
     ClipHolder clipHolder;
 private:
+    void processSegment(juce::AudioBuffer<float>& buffer, const juce::AudioBuffer<float>& sidechain);
+    void applyQualityProfile(const QualityProfile& profile) noexcept;
+    void handleMidiEvent(const juce::MidiMessage& message) noexcept;
+    void timerCallback() override;
+    bool readBinaryState(juce::InputStream& stream);
+    void compileCustomCurve();
+    void valueTreeRedirected(juce::ValueTree& changedTree) override;
+
+    juce::SharedResourcePointer<Tracer> tracer; // объявлен первым, так как переживает фоновые задачи PresetManager
     std::unique_ptr<PresetManager> manager;
 #if OSC
     juce::dsp::Oscillator<float> osc;
 #endif // OSC
-    juce::dsp::Gain<float> inputGain;
-    juce::dsp::Gain<float> outputGain;
+
+    int maxSegmentSize{ 0 }; // размер блока из prepareToPlay, под него выделены рабочие буферы
+    ProcessLoadMeter loadMeter;
+    MorphEndpoints morph; // копия для аудиопотока, без обращений к ValueTree
+    std::atomic<float>* morphParameter{ nullptr };
+    std::atomic<float>* inputGainParameter{ nullptr };
+    std::atomic<float>* outputGainParameter{ nullptr };
+    std::atomic<float>* clipParameter{ nullptr };
+    std::atomic<float>* bypassParameter{ nullptr };
+    std::atomic<float>* linkParameter{ nullptr };
+    std::atomic<float>* clipperTypeParameter{ nullptr };
+    std::atomic<bool> snapshotsOverflowed{ false }; // очередь снимков была полна, аудиопоток соберёт снимок сам
+    enum MidiTarget { midiClip, midiClipperType, midiBypass, numMidiTargets };
+    /* Последнее значение параметра от MIDI, -1 - изменений нет. Пишет аудиопоток,
+    забирает таймер на message thread: частые CC сливаются в одно изменение
+    и не могут переполнить очередь. */
+    std::array<std::atomic<float>, numMidiTargets> midiParameterValues;
+
+    std::atomic<float>* numStagesParameter{ nullptr };
+    std::atomic<float>* autoGainParameter{ nullptr };
+    juce::SharedResourcePointer<AnalysisThread> analysisThread;
+    LoudnessMatcher loudnessMatcher;
+    SpectrumAnalyzer spectrum;
+    HarmonicAnalysisService harmonicAnalysis;
+    juce::SmoothedValue<float, juce::ValueSmoothingTypes::Multiplicative> autoGainCompensation; // линейное усиление
+    std::vector<float> outputGains; // Output Gain с рампой компенсации на каждый сэмпл
+    std::atomic<float>* modulationTargetParameter{ nullptr };
+    std::atomic<float>* modulationShapeParameter{ nullptr };
+    std::atomic<float>* modulationRateParameter{ nullptr };
+    std::atomic<float>* modulationDepthParameter{ nullptr };
+    std::array<std::atomic<float>*, MOD_NUM_STEPS> modulationStepParameters{};
+    ModulationEngine modulation;
+    int modulationTarget{ ModulationEngine::off }; // на текущий блок хоста
+    int segmentOffset{ 0 }; // начало текущего куска в блоке хоста, от него считается фаза модуляции
+    QualityProfile quality;
+    std::atomic<float>* governorParameter{ nullptr };
+    QualityGovernor governor;
+    int analysisBlockCounter{ 0 };
+    std::vector<float> modulationValues;
+    std::atomic<float>* limiterParameter{ nullptr };
+    std::atomic<float>* limiterCeilingParameter{ nullptr };
+    std::atomic<float>* limiterReleaseParameter{ nullptr };
+    TruePeakLimiter limiter;
+    std::atomic<float>* mixParameter{ nullptr };
+    DryDelay dryDelay;
+    std::atomic<float>* emphasisParameter{ nullptr };
+    std::atomic<float>* emphasisFrequencyParameter{ nullptr };
+    EmphasisFilter emphasis;
+    std::atomic<float>* sidechainDriveParameter{ nullptr };
+    std::atomic<float>* sidechainAttackParameter{ nullptr };
+    std::atomic<float>* sidechainReleaseParameter{ nullptr };
+    EnvelopeFollower sidechainFollower;
+    bool sidechainWasActive{ false };
+    std::vector<float> driveGains;
+    std::vector<float> morphDriveGains; // отношения множителей клиппера B морфинга при модуляции Clip
+    std::atomic<float>* transientSplitParameter{ nullptr };
+    std::atomic<float>* transientClipParameter{ nullptr };
+    TransientDetector transientDetector;
+    bool transientWasActive{ false };
+    std::vector<float> transientWeights;
+    bool emphasisWasActive{ false };
+    bool dryCaptured{ false };
+    juce::SmoothedValue<float> mixPosition;
+    std::vector<float> mixWeights;
+    bool limiterWasEnabled{ false };
+    std::array<ClipStage, MAX_CLIP_STAGES - 1> extraStages;
+
+    TripleBuffer<CurveTable> curveTables; // пишет curveCompiler, читает аудиопоток
+    juce::CriticalSection curveLock; // не используется аудиопотоком
+    std::unique_ptr<TransferCurve> pendingCurve; // последняя кривая, ещё не взятая задачей curveCompiler
+    juce::ThreadPool curveCompiler{ 1 }; // объявлен после curveTables, так как дожидается своих задач в деструкторе
+    juce::SmoothedValue<float> morphPosition;
+    std::vector<float> morphWeights;
+    std::vector<float> morphScratch;
 
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DestructionAudioProcessor)